@@ -0,0 +1,107 @@
+#pragma once
+#define _POSIX_C_SOURCE 200809L
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// The benchmarks are standalone programs built and run by `make bench`. Each
+// case is run for a fixed number of iterations after a short warm up, and
+// the time per iteration is printed next to the other cases of its group,
+// e.g. the previous implementation and the current one.
+
+#define BENCH_WARMUP 64
+
+static inline double bench_now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static inline void bench_report(const char* group, const char* name, uint64_t iterations, double seconds) {
+  printf("%-28s %-24s %12.1f ns/op\n", group,
+                                      name,
+                                      1e9 * seconds / iterations);
+}
+
+#define BENCH_RUN(group, name, iterations, ...) do { \
+  for (uint64_t bench_i = 0; bench_i < BENCH_WARMUP; bench_i++) { \
+    __VA_ARGS__; \
+  } \
+  double bench_start = bench_now(); \
+  for (uint64_t bench_i = 0; bench_i < (iterations); bench_i++) { \
+    __VA_ARGS__; \
+  } \
+  bench_report(group, name, iterations, bench_now() - bench_start); \
+} while (0)
+
+// The number of (re)allocations made by lua states of bench_new_state, and
+// the number of bytes they requested, which drives the garbage collector
+static uint64_t g_bench_allocations = 0;
+static uint64_t g_bench_bytes = 0;
+
+static void* bench_alloc(void* context, void* block, size_t size, size_t new_size) {
+  (void)context;
+  if (new_size == 0) {
+    free(block);
+    return NULL;
+  }
+  if (!block || new_size > size) {
+    g_bench_allocations++;
+    g_bench_bytes += block ? new_size - size : new_size;
+  }
+  return realloc(block, new_size);
+}
+
+static inline lua_State* bench_new_state(void) {
+  lua_State* state = lua_newstate(bench_alloc, NULL);
+  luaL_openlibs(state);
+  return state;
+}
+
+// Counts the lua allocations and allocated bytes per iteration instead of
+// the time
+#define BENCH_ALLOCATIONS(group, name, iterations, ...) do { \
+  uint64_t bench_allocations = g_bench_allocations; \
+  uint64_t bench_bytes = g_bench_bytes; \
+  for (uint64_t bench_i = 0; bench_i < (iterations); bench_i++) { \
+    __VA_ARGS__; \
+  } \
+  printf("%-28s %-24s %12.1f lua allocations/op %10.1f bytes/op\n", \
+         group, \
+         name, \
+         (double)(g_bench_allocations - bench_allocations) / (iterations), \
+         (double)(g_bench_bytes - bench_bytes) / (iterations)); \
+} while (0)
+
+// Evaluates the chunk and leaves its first result on the stack
+static inline void bench_eval(lua_State* state, const char* chunk) {
+  if (luaL_loadstring(state, chunk) || lua_pcall(state, 0, 1, 0)) {
+    printf("bench: %s\n", lua_tostring(state, -1));
+    exit(1);
+  }
+}
+
+// Reads the whole file into a NUL terminated buffer
+static inline char* bench_read_file(const char* path, size_t* length) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    printf("bench: can not open %s\n", path);
+    exit(1);
+  }
+
+  fseek(file, 0, SEEK_END);
+  *length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  char* buffer = malloc(*length + 1);
+  if (fread(buffer, 1, *length, file) != *length) {
+    printf("bench: can not read %s\n", path);
+    exit(1);
+  }
+  buffer[*length] = '\0';
+  fclose(file);
+  return buffer;
+}
@@ -0,0 +1,50 @@
+#include "bench.h"
+#include "json.h"
+#include "reference/reference.h"
+
+// Decodes the responses of `--query bar` and `--query <item>` into lua
+// tables, once by building a cJSON tree first as the module did before and
+// once with the single pass decoder pushing the values as it goes.
+
+#define DECODE_ITERATIONS 50000
+
+static const char* g_payloads[] = { "bench/data/bar.json",
+                                    "bench/data/item.json" };
+
+static void decode_reference(lua_State* state, const char* json) {
+  if (!reference_json_to_lua_table(state, json)) exit(1);
+  lua_pop(state, 1);
+}
+
+static void decode_json(lua_State* state, const char* json, size_t length) {
+  if (!json_decode(state, json, json + length)) exit(1);
+  json_arena_reset();
+  lua_pop(state, 1);
+}
+
+int main(void) {
+  lua_State* state = bench_new_state();
+
+  for (uint32_t i = 0; i < sizeof(g_payloads) / sizeof(*g_payloads); i++) {
+    size_t length;
+    char* json = bench_read_file(g_payloads[i], &length);
+
+    char group[64];
+    snprintf(group, sizeof(group), "decode/%s", g_payloads[i] + 11);
+    BENCH_RUN(group, "cJSON (reference)", DECODE_ITERATIONS,
+              decode_reference(state, json));
+    BENCH_RUN(group, "json_decode", DECODE_ITERATIONS,
+              decode_json(state, json, length));
+
+    lua_gc(state, LUA_GCCOLLECT);
+    BENCH_ALLOCATIONS(group, "cJSON (reference)", DECODE_ITERATIONS,
+                      decode_reference(state, json));
+    lua_gc(state, LUA_GCCOLLECT);
+    BENCH_ALLOCATIONS(group, "json_decode", DECODE_ITERATIONS,
+                      decode_json(state, json, length));
+    free(json);
+  }
+
+  lua_close(state);
+  return 0;
+}
@@ -0,0 +1,90 @@
+#include "bench.h"
+#include "callbacks.h"
+#include "reference/callbacks.h"
+
+// Dispatches events to the handler of (item name, event) among thousands of
+// subscriptions, once by scanning all subscriptions as the module did before
+// and once with the hash index. The dispatched events cycle through random
+// subscribed pairs. The overhead of wildcard subscriptions is measured by
+// adding handlers for all items and event patterns, after which every
+// dispatch also looks up the wildcard item and the prefixes of the event.
+
+#define DISPATCH_ITERATIONS 20000
+#define DISPATCH_EVENTS 1024
+
+static const char* g_events[] = { "mouse.entered", "mouse.exited",
+                                  "mouse.clicked", "routine",
+                                  "front_app_switched", "space_change",
+                                  "system_woke", "volume_change",
+                                  "wifi_change", "display_change"        };
+#define DISPATCH_NUM_EVENTS (sizeof(g_events) / sizeof(*g_events))
+
+static const uint32_t g_sizes[] = { 1000, 5000, 10000 };
+
+static volatile uint32_t g_dispatch_sink;
+
+struct dispatch_event {
+  char name[32];
+  uint32_t name_len;
+  const char* event;
+  uint32_t event_len;
+};
+
+static struct dispatch_event g_dispatched[DISPATCH_EVENTS];
+
+static void dispatch_reference(struct reference_callbacks* callbacks, uint64_t i) {
+  struct dispatch_event* event = &g_dispatched[i % DISPATCH_EVENTS];
+  g_dispatch_sink = reference_callbacks_dispatch(callbacks, event->name,
+                                                            event->event);
+}
+
+static void dispatch_hash(struct callbacks* callbacks, uint64_t i) {
+  struct dispatch_event* event = &g_dispatched[i % DISPATCH_EVENTS];
+  g_dispatch_sink = callbacks_match(callbacks, event->name,
+                                               event->name_len,
+                                               event->event,
+                                               event->event_len,
+                                               true             );
+}
+
+int main(void) {
+  srand(24);
+  for (uint32_t i = 0; i < sizeof(g_sizes) / sizeof(*g_sizes); i++) {
+    uint32_t subscriptions = g_sizes[i];
+    uint32_t items = subscriptions / DISPATCH_NUM_EVENTS;
+    struct reference_callbacks reference = { 0 };
+    struct callbacks callbacks = { 0 };
+
+    for (uint32_t item = 0; item < items; item++) {
+      char name[32];
+      snprintf(name, sizeof(name), "item.%u", item);
+      for (uint32_t event = 0; event < DISPATCH_NUM_EVENTS; event++) {
+        int ref = item * DISPATCH_NUM_EVENTS + event + 1;
+        reference_callbacks_add(&reference, name, g_events[event], ref);
+        callbacks_add(&callbacks, name, g_events[event], ref, true);
+      }
+    }
+
+    for (uint32_t j = 0; j < DISPATCH_EVENTS; j++) {
+      struct dispatch_event* event = &g_dispatched[j];
+      event->name_len = snprintf(event->name, sizeof(event->name), "item.%u",
+                                 (uint32_t)rand() % items                     );
+      event->event = g_events[rand() % DISPATCH_NUM_EVENTS];
+      event->event_len = strlen(event->event);
+    }
+
+    char group[64];
+    snprintf(group, sizeof(group), "dispatch/%u", subscriptions);
+    BENCH_RUN(group, "linear (reference)", DISPATCH_ITERATIONS,
+              dispatch_reference(&reference, bench_i));
+    BENCH_RUN(group, "hash", DISPATCH_ITERATIONS,
+              dispatch_hash(&callbacks, bench_i));
+
+    callbacks_add(&callbacks, "*", "routine", -1, true);
+    callbacks_add(&callbacks, "*", "mouse.*", -2, true);
+    callbacks_add(&callbacks, "item.0", "*", -3, true);
+    BENCH_RUN(group, "hash + wildcards", DISPATCH_ITERATIONS,
+              dispatch_hash(&callbacks, bench_i));
+  }
+  return 0;
+}
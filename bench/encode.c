@@ -0,0 +1,98 @@
+#include "bench.h"
+#include "parsing.h"
+#include "reference/reference.h"
+
+// Encodes the `--set` commands of example/items/spaces.lua, once with the
+// message builder writing the tokens in wire order and once by pushing them
+// in reverse onto a stack, which is then flattened as the module did before.
+
+#define ENCODE_ITERATIONS 200000
+
+struct encode_case {
+  const char* name;
+  const char* table;
+};
+
+static const struct encode_case g_cases[] = {
+  { "space", "return {"
+             "  associated_space = 1,"
+             "  icon = {"
+             "    string = 1,"
+             "    padding_left = 10,"
+             "    padding_right = 10,"
+             "    color = 0xffcad3f5,"
+             "    highlight_color = 0xffed8796,"
+             "  },"
+             "  padding_left = 2,"
+             "  padding_right = 2,"
+             "  label = {"
+             "    padding_right = 20,"
+             "    color = 0xff939ab7,"
+             "    highlight_color = 0xffcad3f5,"
+             "    font = 'sketchybar-app-font:Regular:16.0',"
+             "    y_offset = -1,"
+             "    drawing = false,"
+             "  },"
+             "}" },
+  { "space_selection", "return {"
+                       "  icon = { highlight = 'true' },"
+                       "  label = { highlight = 'true' },"
+                       "  background = { border_color = 0xffcad3f5 }"
+                       "}" },
+  { "bracket", "return {"
+               "  background = { color = 0x803c3e4f,"
+               "                 border_color = 0xff494d64 }"
+               "}" },
+  { "space_creator", "return {"
+                     "  padding_left = 10,"
+                     "  padding_right = 8,"
+                     "  icon = {"
+                     "    string = '+',"
+                     "    font = { style = 'Heavy', size = 16.0 },"
+                     "  },"
+                     "  label = { drawing = false },"
+                     "  associated_display = 'active',"
+                     "}" },
+};
+
+static void encode_message(lua_State* state, const char* name) {
+  struct message message;
+  message_init(&message);
+  message_push(&message, "--set");
+  message_push(&message, name);
+  parse_kv_table(state, &message, true);
+  message_clean(&message);
+}
+
+static void encode_stack(lua_State* state, const char* name) {
+  struct stack* stack = stack_create();
+  stack_init(stack);
+  reference_parse_kv_table(state, NULL, stack);
+  stack_push(stack, name);
+  stack_push(stack, "--set");
+
+  uint32_t length;
+  free(stack_flatten_ttb(stack, &length));
+  stack_destroy(stack);
+}
+
+int main(void) {
+  lua_State* state = luaL_newstate();
+  luaL_openlibs(state);
+
+  for (uint32_t i = 0; i < sizeof(g_cases) / sizeof(*g_cases); i++) {
+    const struct encode_case* test = &g_cases[i];
+    bench_eval(state, test->table);
+
+    char group[64];
+    snprintf(group, sizeof(group), "encode/%s", test->name);
+    BENCH_RUN(group, "stack (reference)", ENCODE_ITERATIONS,
+              encode_stack(state, test->name));
+    BENCH_RUN(group, "message", ENCODE_ITERATIONS,
+              encode_message(state, test->name));
+    lua_pop(state, 1);
+  }
+
+  lua_close(state);
+  return 0;
+}
@@ -0,0 +1,109 @@
+#include "bench.h"
+#include "env.h"
+#include "json.h"
+#include "reference/env.h"
+
+// Reads the env block of a space_windows_change event with a large INFO
+// payload, once with the strlen scans the module used before and once with
+// the env index. The INFO variable precedes NAME and SENDER in the block,
+// such that lookups have to get past it. An event is dispatched by looking
+// up NAME and SENDER, and a handler reading INFO, or all variables
+// converted into a table.
+
+#define ENV_ITERATIONS 20000
+#define ENV_APPS 200
+
+static const char* volatile g_env_sink;
+
+static char* env_block(size_t* size) {
+  static const char* variables[] = { "BAR_NAME", "sketchybar",
+                                     "CONFIG_DIR", "/Users/user/.config/sketchybar",
+                                     "SELECTED", "false" };
+  char* block = malloc(64 * ENV_APPS + 1024);
+  size_t length = 0;
+
+  length += sprintf(block + length, "INFO") + 1;
+  length += sprintf(block + length, "{\"space\": 3, \"apps\": {");
+  for (uint32_t i = 0; i < ENV_APPS; i++) {
+    length += sprintf(block + length, "%s\"Application %u\": %u",
+                                      i ? ", " : "",
+                                      i,
+                                      i % 7 + 1                  );
+  }
+  length += sprintf(block + length, "}}") + 1;
+
+  for (uint32_t i = 0; i < sizeof(variables) / sizeof(*variables); i++)
+    length += sprintf(block + length, "%s", variables[i]) + 1;
+  length += sprintf(block + length, "NAME") + 1;
+  length += sprintf(block + length, "space.3") + 1;
+  length += sprintf(block + length, "SENDER") + 1;
+  length += sprintf(block + length, "space_windows_change") + 1;
+  block[length++] = '\0';
+  *size = length;
+  return block;
+}
+
+static void env_lookup_reference(char* env) {
+  g_env_sink = reference_env_get_value_for_key(env, "NAME");
+  g_env_sink = reference_env_get_value_for_key(env, "SENDER");
+  g_env_sink = reference_env_get_value_for_key(env, "INFO");
+}
+
+static void env_lookup_index(struct env_index* index, char* env, size_t size) {
+  env_index_build(index, env, size);
+  g_env_sink = env_index_find(index, "NAME")->value;
+  g_env_sink = env_index_find(index, "SENDER")->value;
+  g_env_sink = env_index_find(index, "INFO")->value;
+}
+
+static void env_table_reference(lua_State* state, char* env) {
+  g_env_sink = reference_env_get_value_for_key(env, "NAME");
+  g_env_sink = reference_env_get_value_for_key(env, "SENDER");
+
+  lua_newtable(state);
+  struct reference_key_value_pair kv = { NULL, NULL };
+  for (;;) {
+    kv = reference_env_get_next_key_value_pair(env, kv);
+    if (!kv.key || !kv.value) break;
+    lua_pushstring(state, kv.key);
+    lua_pushstring(state, kv.value);
+    lua_settable(state, -3);
+  }
+  lua_pop(state, 1);
+}
+
+static void env_table_index(lua_State* state, struct env_index* index, char* env, size_t size) {
+  env_index_build(index, env, size);
+  g_env_sink = env_index_find(index, "NAME")->value;
+  g_env_sink = env_index_find(index, "SENDER")->value;
+
+  lua_createtable(state, 0, index->num_entries);
+  for (uint32_t i = 0; i < index->num_entries; i++) {
+    struct env_entry* entry = &index->entries[i];
+    json_push_key(state, entry->key, entry->key_len);
+    lua_pushlstring(state, entry->value, entry->value_len);
+    lua_rawset(state, -3);
+  }
+  lua_pop(state, 1);
+}
+
+int main(void) {
+  lua_State* state = bench_new_state();
+  struct env_index index = { 0 };
+  size_t size;
+  char* env = env_block(&size);
+
+  BENCH_RUN("env/lookup", "strlen scans (reference)", ENV_ITERATIONS,
+            env_lookup_reference(env));
+  BENCH_RUN("env/lookup", "env index", ENV_ITERATIONS,
+            env_lookup_index(&index, env, size));
+  BENCH_RUN("env/table", "strlen scans (reference)", ENV_ITERATIONS,
+            env_table_reference(state, env));
+  BENCH_RUN("env/table", "env index", ENV_ITERATIONS,
+            env_table_index(state, &index, env, size));
+
+  free(index.entries);
+  free(env);
+  lua_close(state);
+  return 0;
+}
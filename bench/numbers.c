@@ -0,0 +1,86 @@
+#include "bench.h"
+#include "parsing.h"
+#include "reference/reference.h"
+
+// Encodes a property table consisting mostly of integers, floats and colors,
+// once with the formatters writing straight into the message and once with
+// lua_tostring, which interns a new lua string for every number. Some of the
+// values change with every iteration, like the widths and offsets of items
+// updated by events do.
+
+#define NUMBERS_ITERATIONS 200000
+
+static const char g_table[] = "return {"
+  "  width = 120,"
+  "  y_offset = -2.5,"
+  "  padding_left = 4,"
+  "  padding_right = 4,"
+  "  scale = 1.25,"
+  "  icon = {"
+  "    color = 0xffcad3f5,"
+  "    padding_left = 3,"
+  "    padding_right = 6,"
+  "    y_offset = 1.5,"
+  "    font = { size = 14.0 },"
+  "  },"
+  "  label = {"
+  "    color = 0xff939ab7,"
+  "    width = 42,"
+  "    y_offset = 0.5,"
+  "    padding_right = 8,"
+  "    max_chars = 24,"
+  "  },"
+  "  background = {"
+  "    color = 0x803c3e4f,"
+  "    border_color = 0xff494d64,"
+  "    border_width = 2,"
+  "    corner_radius = 9,"
+  "    height = 26,"
+  "    y_offset = 0,"
+  "  },"
+  "}";
+
+static void numbers_update(lua_State* state, uint64_t iteration) {
+  lua_pushinteger(state, 100 + iteration % 1000);
+  lua_setfield(state, -2, "width");
+  lua_pushnumber(state, (double)(iteration % 1000) / 8.);
+  lua_setfield(state, -2, "y_offset");
+}
+
+static void numbers_message(lua_State* state, uint64_t iteration) {
+  numbers_update(state, iteration);
+  struct message message;
+  message_init(&message);
+  message_push(&message, "--set");
+  message_push(&message, "cpu");
+  parse_kv_table(state, &message, true);
+  message_clean(&message);
+}
+
+static void numbers_lua_tostring(lua_State* state, uint64_t iteration) {
+  numbers_update(state, iteration);
+  struct stack* stack = stack_create();
+  stack_init(stack);
+  reference_parse_kv_table(state, NULL, stack);
+  stack_destroy(stack);
+}
+
+int main(void) {
+  lua_State* state = bench_new_state();
+  bench_eval(state, g_table);
+
+  BENCH_RUN("numbers", "lua_tostring (reference)", NUMBERS_ITERATIONS,
+            numbers_lua_tostring(state, bench_i));
+  BENCH_RUN("numbers", "formatters", NUMBERS_ITERATIONS,
+            numbers_message(state, bench_i));
+
+  lua_gc(state, LUA_GCCOLLECT);
+  BENCH_ALLOCATIONS("numbers", "lua_tostring (reference)", NUMBERS_ITERATIONS,
+                    numbers_lua_tostring(state, bench_i));
+  lua_gc(state, LUA_GCCOLLECT);
+  BENCH_ALLOCATIONS("numbers", "formatters", NUMBERS_ITERATIONS,
+                    numbers_message(state, bench_i));
+
+  lua_close(state);
+  return 0;
+}
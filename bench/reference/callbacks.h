@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The event callbacks of the module before the hash index, kept for
+// comparison by the benchmarks. Every subscription is allocated on its own
+// and both subscribing and dispatching scan all of them.
+
+struct reference_callback {
+  int callback_ref;
+  char* name;
+  char* event;
+};
+
+struct reference_callbacks {
+  struct reference_callback** callbacks;
+  uint32_t num_callbacks;
+};
+
+static inline char* reference_clone(const char* string) {
+  char* clone = malloc(strlen(string) + 1);
+  memcpy(clone, string, strlen(string) + 1);
+  return clone;
+}
+
+static inline void reference_callbacks_add(struct reference_callbacks* callbacks, const char* name, const char* event, int callback_ref) {
+  int index = -1;
+  for (uint32_t i = 0; i < callbacks->num_callbacks; i++) {
+    if (strcmp(callbacks->callbacks[i]->name, name) == 0
+        && strcmp(callbacks->callbacks[i]->event, event) == 0) {
+      index = i;
+      break;
+    }
+  }
+
+  if (index < 0) {
+    callbacks->callbacks = realloc(callbacks->callbacks,
+                                   sizeof(struct reference_callback*)
+                                   * ++callbacks->num_callbacks);
+
+    struct reference_callback* callback = malloc(sizeof(struct reference_callback));
+    callback->name = reference_clone(name);
+    callback->event = reference_clone(event);
+    callback->callback_ref = callback_ref;
+    callbacks->callbacks[callbacks->num_callbacks - 1] = callback;
+  } else {
+    callbacks->callbacks[index]->callback_ref = callback_ref;
+  }
+}
+
+// Returns the callback ref of the subscription, or 0 if there is none
+static inline int reference_callbacks_dispatch(struct reference_callbacks* callbacks, const char* name, const char* sender) {
+  for (uint32_t i = 0; i < callbacks->num_callbacks; i++) {
+    if (strcmp(callbacks->callbacks[i]->name, name) == 0
+        && strcmp(callbacks->callbacks[i]->event, sender) == 0) {
+      return callbacks->callbacks[i]->callback_ref;
+    }
+  }
+  return 0;
+}
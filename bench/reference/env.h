@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+// The env block accessors of the module before the env index, kept for
+// comparison by the benchmarks. Every lookup scans the block from its start
+// and measures the keys and values it passes with strlen.
+
+struct reference_key_value_pair {
+  char* key;
+  char* value;
+};
+
+static inline char* reference_env_get_value_for_key(char* env, char* key) {
+  uint32_t caret = 0;
+  for(;;) {
+    if (!env[caret]) break;
+    if (strcmp(&env[caret], key) == 0)
+      return &env[caret + strlen(&env[caret]) + 1];
+
+    caret += strlen(&env[caret])
+             + strlen(&env[caret + strlen(&env[caret]) + 1])
+             + 2;
+  }
+  return (char*)"";
+}
+
+static inline struct reference_key_value_pair reference_env_get_next_key_value_pair(char* env, struct reference_key_value_pair prev) {
+  uint32_t caret = 0;
+  if (prev.key != NULL) {
+    caret = (prev.key - env) + strlen(&env[(prev.key - env)])
+                             + strlen(&env[(prev.key - env)
+                                      + strlen(&env[(prev.key - env)])
+                                      + 1                             ])
+                             + 2;
+  }
+
+  if (!env[caret]) return (struct reference_key_value_pair) { NULL, NULL };
+
+  return (struct reference_key_value_pair) { env + caret,
+                                             env + caret + strlen(&env[caret]) +1 };
+}
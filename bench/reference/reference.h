@@ -0,0 +1,12 @@
+#pragma once
+#include <lua.h>
+#include <lauxlib.h>
+#include <stdbool.h>
+#include "cJSON.h"
+#include "stack.h"
+
+// The previous implementations of the module, which the benchmarks compare
+// the current ones against
+
+void reference_parse_kv_table(lua_State* state, char* prefix, struct stack* stack);
+bool reference_json_to_lua_table(lua_State* state, const char* json_str);
@@ -1,12 +1,12 @@
 #pragma once
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define m_clone(dst, src) { \
-  dst = malloc(strlen(src) + 1); \
-  memcpy(dst, src, strlen(src) + 1); \
-}
+// The command builder of the module before the message builder, kept for
+// comparison by the benchmarks. Tokens are pushed in reverse and reversed
+// again by stack_flatten_ttb.
 
 struct stack {
   char** value;
@@ -23,25 +23,8 @@ static inline void stack_init(struct stack* stack) {
 
 static inline void stack_push(struct stack* stack, const char* value) {
   stack->value = realloc(stack->value, (sizeof(char*) * ++stack->num_values));
-  m_clone(stack->value[stack->num_values - 1], value);
-}
-
-static inline void stack_copy(struct stack* stack, struct stack* copy) {
-  stack_init(copy);
-
-  for (int i = 0; i < stack->num_values; i++)
-    stack_push(copy, stack->value[i]);
-}
-
-
-static inline void stack_pop(struct stack* stack) {
-  if (stack->num_values == 0) return;
-
-  if (stack->value[stack->num_values - 1])
-    free(stack->value[stack->num_values - 1]);
-
-  stack->value[stack->num_values - 1] = NULL;
-  stack->num_values--;
+  stack->value[stack->num_values - 1] = malloc(strlen(value) + 1);
+  memcpy(stack->value[stack->num_values - 1], value, strlen(value) + 1);
 }
 
 static inline void stack_clean(struct stack* stack) {
@@ -76,10 +59,3 @@ static inline char* stack_flatten_ttb(struct stack* stack, uint32_t* length) {
 
   return out;
 }
-
-static inline void stack_print(struct stack* stack) {
-  for (uint32_t i = 0; i < stack->num_values - 1; i++)
-    printf("%s -> ", stack->value[i]);
-  if (stack->num_values > 0)
-    printf("%s\n", stack->value[stack->num_values - 1]);
-}
@@ -0,0 +1,45 @@
+#include "bench.h"
+#include "json_scan.h"
+#include <string.h>
+
+// Scans long string contents and whitespace runs, like long label values,
+// lists of app names or pretty printed responses, once byte by byte and
+// once with the SIMD scanners (if the build has any).
+
+#define SCAN_ITERATIONS 200000
+
+static const char* volatile g_scan_sink;
+
+static const uint32_t g_lengths[] = { 16, 64, 256, 4096 };
+
+int main(void) {
+#ifndef JSON_SIMD_WIDTH
+  printf("scan: built without SIMD, both cases are scalar\n");
+#endif
+  for (uint32_t i = 0; i < sizeof(g_lengths) / sizeof(*g_lengths); i++) {
+    uint32_t length = g_lengths[i];
+    // The match is the last byte, such that all bytes are scanned
+    char* text = malloc(length);
+    memset(text, 'a', length - 1);
+    text[length - 1] = '"';
+    char* space = malloc(length);
+    memset(space, ' ', length - 1);
+    space[length - 1] = '{';
+
+    char group[64];
+    snprintf(group, sizeof(group), "scan/string/%u", length);
+    BENCH_RUN(group, "scalar (reference)", SCAN_ITERATIONS,
+              g_scan_sink = json_scalar_find_special(text, text + length));
+    BENCH_RUN(group, "json_find_special", SCAN_ITERATIONS,
+              g_scan_sink = json_find_special(text, text + length));
+
+    snprintf(group, sizeof(group), "scan/whitespace/%u", length);
+    BENCH_RUN(group, "scalar (reference)", SCAN_ITERATIONS,
+              g_scan_sink = json_scalar_whitespace_end(space, space + length));
+    BENCH_RUN(group, "json_whitespace_end", SCAN_ITERATIONS,
+              g_scan_sink = json_whitespace_end(space, space + length));
+    free(text);
+    free(space);
+  }
+  return 0;
+}
@@ -0,0 +1,106 @@
+#include "bench.h"
+#include "json.h"
+#include "reference/reference.h"
+#include <string.h>
+
+// Decodes large documents into lua tables, once growing every table from
+// lua_newtable as the module did before and once with the tables created
+// at their final size. The documents are a bar with many items, the INFO of
+// a space_windows_change event with many apps and a list of many queried
+// items.
+
+#define TABLES_ITERATIONS 2000
+#define TABLES_ITEMS 400
+
+struct tables_buffer {
+  char* data;
+  size_t length;
+  size_t size;
+};
+
+static void tables_append(struct tables_buffer* buffer, const char* string) {
+  size_t length = strlen(string);
+  if (buffer->length + length + 1 > buffer->size) {
+    buffer->size = 2 * (buffer->length + length + 1);
+    buffer->data = realloc(buffer->data, buffer->size);
+  }
+  memcpy(buffer->data + buffer->length, string, length + 1);
+  buffer->length += length;
+}
+
+static char* tables_bar(void) {
+  struct tables_buffer buffer = { 0 };
+  tables_append(&buffer, "{\"position\": \"top\", \"height\": 40, \"items\": [");
+  for (uint32_t i = 0; i < TABLES_ITEMS; i++) {
+    char item[32];
+    snprintf(item, sizeof(item), "%s\"item.%u\"", i ? ", " : "", i);
+    tables_append(&buffer, item);
+  }
+  tables_append(&buffer, "]}");
+  return buffer.data;
+}
+
+static char* tables_space_windows(void) {
+  struct tables_buffer buffer = { 0 };
+  tables_append(&buffer, "{\"space\": 3, \"apps\": {");
+  for (uint32_t i = 0; i < TABLES_ITEMS; i++) {
+    char app[48];
+    snprintf(app, sizeof(app), "%s\"Application %u\": %u", i ? ", " : "",
+                                                           i,
+                                                           i % 7 + 1        );
+    tables_append(&buffer, app);
+  }
+  tables_append(&buffer, "}}");
+  return buffer.data;
+}
+
+static char* tables_items(void) {
+  size_t length;
+  char* item = bench_read_file("bench/data/item.json", &length);
+  struct tables_buffer buffer = { 0 };
+  tables_append(&buffer, "[");
+  for (uint32_t i = 0; i < TABLES_ITEMS / 8; i++) {
+    if (i) tables_append(&buffer, ",");
+    tables_append(&buffer, item);
+  }
+  tables_append(&buffer, "]");
+  free(item);
+  return buffer.data;
+}
+
+static void tables_reference(lua_State* state, const char* json) {
+  if (!reference_json_to_lua_table(state, json)) exit(1);
+  lua_pop(state, 1);
+}
+
+static void tables_presized(lua_State* state, const char* json) {
+  if (!json_to_lua_table(state, json)) exit(1);
+  json_arena_reset();
+  lua_pop(state, 1);
+}
+
+int main(void) {
+  lua_State* state = bench_new_state();
+
+  const char* names[] = { "bar", "space_windows", "items" };
+  char* payloads[] = { tables_bar(), tables_space_windows(), tables_items() };
+  for (uint32_t i = 0; i < sizeof(payloads) / sizeof(*payloads); i++) {
+    char group[64];
+    snprintf(group, sizeof(group), "tables/%s", names[i]);
+    BENCH_RUN(group, "lua_newtable (reference)", TABLES_ITERATIONS,
+              tables_reference(state, payloads[i]));
+    BENCH_RUN(group, "presized", TABLES_ITERATIONS,
+              tables_presized(state, payloads[i]));
+
+    lua_gc(state, LUA_GCCOLLECT);
+    BENCH_ALLOCATIONS(group, "lua_newtable (reference)", TABLES_ITERATIONS,
+                      tables_reference(state, payloads[i]));
+    lua_gc(state, LUA_GCCOLLECT);
+    BENCH_ALLOCATIONS(group, "presized", TABLES_ITERATIONS,
+                      tables_presized(state, payloads[i]));
+    free(payloads[i]);
+  }
+
+  lua_close(state);
+  return 0;
+}
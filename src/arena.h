@@ -0,0 +1,93 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// A bump allocator for scratch memory which is only needed while a single
+// message is processed. Allocations are never freed individually, the whole
+// arena is reset once the message is done. If the arena ran out of space
+// while processing a message, all of its chunks are merged into a single
+// larger chunk on reset, such that the steady state needs no allocations.
+
+#define ARENA_INITIAL_SIZE 4096
+#define ARENA_ALIGNMENT 8
+
+struct arena_chunk {
+  struct arena_chunk* next;
+  uint32_t size;
+  char data[];
+};
+
+struct arena {
+  struct arena_chunk* chunks;
+  uint32_t used;
+  uint32_t total;
+
+#ifdef STATS
+  uint32_t num_allocations;
+  uint32_t num_chunk_allocations;
+  uint32_t bytes;
+#endif
+};
+
+static inline void arena_add_chunk(struct arena* arena, uint32_t size) {
+  struct arena_chunk* chunk = malloc(sizeof(struct arena_chunk) + size);
+  chunk->next = arena->chunks;
+  chunk->size = size;
+  arena->chunks = chunk;
+  arena->used = 0;
+  arena->total += size;
+
+#ifdef STATS
+  arena->num_chunk_allocations++;
+#endif
+}
+
+static inline void* arena_alloc(struct arena* arena, uint32_t size) {
+  size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+  if (!arena->chunks || arena->used + size > arena->chunks->size) {
+    uint32_t chunk_size = arena->chunks ? 2 * arena->chunks->size
+                                        : ARENA_INITIAL_SIZE;
+    while (chunk_size < size) chunk_size *= 2;
+    arena_add_chunk(arena, chunk_size);
+  }
+
+#ifdef STATS
+  arena->num_allocations++;
+  arena->bytes += size;
+#endif
+
+  void* memory = arena->chunks->data + arena->used;
+  arena->used += size;
+  return memory;
+}
+
+static inline void arena_reset(struct arena* arena) {
+#ifdef STATS
+  if (arena->num_allocations) {
+    printf("[i] arena: %u allocations (%u bytes), %u chunk allocations\n",
+           arena->num_allocations,
+           arena->bytes,
+           arena->num_chunk_allocations                                    );
+  }
+  arena->num_allocations = 0;
+  arena->num_chunk_allocations = 0;
+  arena->bytes = 0;
+#endif
+
+  if (arena->chunks && arena->chunks->next) {
+    uint32_t total = arena->total;
+    while (arena->chunks) {
+      struct arena_chunk* next = arena->chunks->next;
+      free(arena->chunks);
+      arena->chunks = next;
+    }
+    arena->total = 0;
+    arena_add_chunk(arena, total);
+
+#ifdef STATS
+    arena->num_chunk_allocations = 0;
+#endif
+  }
+  arena->used = 0;
+}
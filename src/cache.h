@@ -0,0 +1,79 @@
+#pragma once
+#include "hash.h"
+#include "message.h"
+#include <stdbool.h>
+
+// The query cache keeps the last query response of every item for `ttl`
+// seconds, such that repeated queries do not need a round trip to
+// sketchybar. Every command of the module changing an item invalidates the
+// cached response of that item.
+
+struct query_cache_entry {
+  struct hash_entry entry;
+  char* response;
+  uint32_t response_len;
+  double expiry;
+};
+
+struct query_cache {
+  double ttl;
+  struct hash_table entries;
+};
+
+static inline void query_cache_entry_clear(struct query_cache_entry* entry) {
+  if (entry->response) free(entry->response);
+  entry->response = NULL;
+  entry->response_len = 0;
+}
+
+static inline struct query_cache_entry* query_cache_get_entry(struct query_cache* cache, const char* name, bool create) {
+  return (struct query_cache_entry*)hash_table_get(&cache->entries,
+                                                   name,
+                                                   sizeof(struct query_cache_entry),
+                                                   create                          );
+}
+
+static inline void query_cache_invalidate_all(struct query_cache* cache) {
+  for (uint32_t i = 0; i < cache->entries.entries_size; i++) {
+    struct query_cache_entry* entry
+                         = (struct query_cache_entry*)cache->entries.entries[i];
+    if (entry) query_cache_entry_clear(entry);
+  }
+}
+
+static inline void query_cache_invalidate(struct query_cache* cache, const char* name) {
+  if (!name) return;
+  if (*name == '/') {
+    // Regex targets may touch any item
+    query_cache_invalidate_all(cache);
+    return;
+  }
+
+  struct query_cache_entry* entry = query_cache_get_entry(cache, name, false);
+  if (entry) query_cache_entry_clear(entry);
+}
+
+// Returns the cached response of the item if it has not yet expired
+static inline struct query_cache_entry* query_cache_lookup(struct query_cache* cache, const char* name, double now) {
+  if (cache->ttl <= 0. || !name) return NULL;
+
+  struct query_cache_entry* entry = query_cache_get_entry(cache, name, false);
+  if (!entry || !entry->response) return NULL;
+  if (now >= entry->expiry) {
+    query_cache_entry_clear(entry);
+    return NULL;
+  }
+  return entry;
+}
+
+static inline void query_cache_store(struct query_cache* cache, const char* name, const char* response, uint32_t length, double now) {
+  if (cache->ttl <= 0. || !name || *name == '/') return;
+
+  struct query_cache_entry* entry = query_cache_get_entry(cache, name, true);
+  query_cache_entry_clear(entry);
+  entry->response_len = length;
+  entry->response = malloc(length + 1);
+  memcpy(entry->response, response, length);
+  entry->response[length] = '\0';
+  entry->expiry = now + cache->ttl;
+}
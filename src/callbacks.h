@@ -0,0 +1,367 @@
+#pragma once
+#include "hash.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The event callbacks are kept contiguously in the order of subscription and
+// are indexed by an open addressing table keyed by (item name, event), such
+// that dispatching an event does not depend on the number of subscriptions.
+// Every key holds a list of handlers, which are called in the order they
+// were subscribed in.
+//
+// The item name "*" matches all items, and an event ending in ".*" matches
+// all events starting with the part before the "*" ("*" alone matches all
+// events). Wildcard keys live in the same table: an event is dispatched by
+// looking up the item and the wildcard item, each with the exact event and
+// then with every prefix pattern of the event, from the longest prefix to
+// "*". These lookups are skipped while no such key exists.
+
+#define CALLBACKS_INITIAL_SLOTS 64
+#define CALLBACKS_WILDCARD "*"
+
+struct callback_handler {
+  int callback_ref;
+  // Functions without parameters are called without building the env table
+  bool wants_env;
+};
+
+struct callback {
+  char* name;
+  uint32_t name_len;
+  char* event;
+  uint32_t event_len;
+  uint32_t hash;
+
+  struct callback_handler* handlers;
+  uint32_t num_handlers;
+  uint32_t handlers_size;
+};
+
+struct callbacks {
+  struct callback* callbacks;
+  uint32_t num_callbacks;
+  uint32_t callbacks_size;
+
+  // Indices into `callbacks` offset by one, zero marks an empty slot
+  uint32_t* slots;
+  uint32_t slots_size;
+
+  uint32_t num_wildcard_names;
+  uint32_t num_patterns;
+
+  // The handlers matched by the last call to callbacks_match
+  struct callback_handler* matched;
+  uint32_t num_matched;
+  uint32_t matched_size;
+
+  // The callback refs of removed handlers, which are not yet released
+  int* released;
+  uint32_t num_released;
+  uint32_t released_size;
+};
+
+// Selects the item names removed by callbacks_remove and callback_names_remove
+typedef bool callbacks_filter(const char* name, void* context);
+
+// A set of names in insertion order, for the items and events known to the
+// module
+struct callback_name {
+  char* name;
+  uint32_t hash;
+};
+
+struct callback_names {
+  struct callback_name* names;
+  uint32_t num_names;
+  uint32_t names_size;
+
+  uint32_t* slots;
+  uint32_t slots_size;
+};
+
+// Hashes the name and the event, followed by a "*" if `pattern` is set. This
+// hashes a pattern the same whether it is passed as "mouse.*" or as the
+// prefix "mouse." of an event.
+static inline uint32_t callbacks_hash(const char* name, uint32_t name_len, const char* event, uint32_t event_len, bool pattern) {
+  uint32_t hash = hash_fnv(HASH_SEED, name, name_len);
+  // Separates the name from the event, such that ("ab", "c") != ("a", "bc")
+  hash *= HASH_PRIME;
+  hash = hash_fnv(hash, event, event_len);
+  return pattern ? hash_fnv(hash, CALLBACKS_WILDCARD, 1) : hash;
+}
+
+static inline bool callbacks_is_wildcard(const char* name, uint32_t name_len) {
+  return name_len == 1 && *name == '*';
+}
+
+static inline bool callbacks_is_pattern(const char* event, uint32_t event_len) {
+  return callbacks_is_wildcard(event, event_len)
+         || (event_len >= 2 && event[event_len - 2] == '.'
+                            && event[event_len - 1] == '*');
+}
+
+static inline bool callbacks_pattern_matches(const char* pattern, uint32_t pattern_len, const char* event, uint32_t event_len) {
+  return event_len >= pattern_len - 1
+         && memcmp(pattern, event, pattern_len - 1) == 0;
+}
+
+static inline uint32_t* callbacks_slot(struct callbacks* callbacks, const char* name, uint32_t name_len, const char* event, uint32_t event_len, bool pattern, uint32_t hash) {
+  uint32_t mask = callbacks->slots_size - 1;
+  for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+    uint32_t* slot = &callbacks->slots[i];
+    if (!*slot) return slot;
+
+    struct callback* callback = &callbacks->callbacks[*slot - 1];
+    if (callback->hash == hash
+        && callback->name_len == name_len
+        && callback->event_len == event_len + pattern
+        && memcmp(callback->name, name, name_len) == 0
+        && memcmp(callback->event, event, event_len) == 0
+        && (!pattern || callback->event[event_len] == '*')) {
+      return slot;
+    }
+  }
+}
+
+static inline struct callback* callbacks_find(struct callbacks* callbacks, const char* name, uint32_t name_len, const char* event, uint32_t event_len, bool pattern) {
+  if (!callbacks->slots_size) return NULL;
+
+  uint32_t hash = callbacks_hash(name, name_len, event, event_len, pattern);
+  uint32_t* slot = callbacks_slot(callbacks, name, name_len,
+                                             event, event_len, pattern, hash);
+  return *slot ? &callbacks->callbacks[*slot - 1] : NULL;
+}
+
+static inline void callbacks_rehash(struct callbacks* callbacks, uint32_t slots_size) {
+  if (callbacks->slots) free(callbacks->slots);
+  callbacks->slots_size = slots_size;
+  callbacks->slots = calloc(slots_size, sizeof(uint32_t));
+  for (uint32_t i = 0; i < callbacks->num_callbacks; i++) {
+    struct callback* callback = &callbacks->callbacks[i];
+    *callbacks_slot(callbacks, callback->name, callback->name_len,
+                               callback->event, callback->event_len,
+                               false, callback->hash                ) = i + 1;
+  }
+}
+
+static inline struct callback* callbacks_get(struct callbacks* callbacks, const char* name, const char* event) {
+  if (2 * (callbacks->num_callbacks + 1) > callbacks->slots_size) {
+    callbacks_rehash(callbacks, callbacks->slots_size
+                                ? 2 * callbacks->slots_size
+                                : CALLBACKS_INITIAL_SLOTS  );
+  }
+
+  uint32_t name_len = strlen(name);
+  uint32_t event_len = strlen(event);
+  uint32_t hash = callbacks_hash(name, name_len, event, event_len, false);
+  uint32_t* slot = callbacks_slot(callbacks, name, name_len,
+                                             event, event_len, false, hash);
+  if (*slot) return &callbacks->callbacks[*slot - 1];
+
+  if (callbacks->num_callbacks == callbacks->callbacks_size) {
+    callbacks->callbacks_size = callbacks->callbacks_size
+                                ? 2 * callbacks->callbacks_size
+                                : CALLBACKS_INITIAL_SLOTS / 2;
+    callbacks->callbacks = realloc(callbacks->callbacks,
+                                   sizeof(struct callback)
+                                   * callbacks->callbacks_size);
+  }
+
+  struct callback* callback = &callbacks->callbacks[callbacks->num_callbacks];
+  memset(callback, 0, sizeof(struct callback));
+  callback->name = malloc(name_len + 1);
+  memcpy(callback->name, name, name_len + 1);
+  callback->name_len = name_len;
+  callback->event = malloc(event_len + 1);
+  memcpy(callback->event, event, event_len + 1);
+  callback->event_len = event_len;
+  callback->hash = hash;
+  *slot = ++callbacks->num_callbacks;
+
+  if (callbacks_is_wildcard(name, name_len)) callbacks->num_wildcard_names++;
+  if (callbacks_is_pattern(event, event_len)) callbacks->num_patterns++;
+  return callback;
+}
+
+static inline void callbacks_release(struct callbacks* callbacks, int callback_ref) {
+  for (uint32_t i = 0; i < callbacks->num_released; i++) {
+    if (callbacks->released[i] == callback_ref) return;
+  }
+
+  if (callbacks->num_released == callbacks->released_size) {
+    callbacks->released_size = callbacks->released_size
+                               ? 2 * callbacks->released_size
+                               : 8;
+    callbacks->released = realloc(callbacks->released,
+                                  sizeof(int) * callbacks->released_size);
+  }
+  callbacks->released[callbacks->num_released++] = callback_ref;
+}
+
+// Removes the keys of all items selected by the filter, the wildcard item is
+// never removed. The refs of their handlers are collected in `released`.
+static inline void callbacks_remove(struct callbacks* callbacks, callbacks_filter* filter, void* context) {
+  uint32_t num_callbacks = 0;
+  for (uint32_t i = 0; i < callbacks->num_callbacks; i++) {
+    struct callback* callback = &callbacks->callbacks[i];
+    if (callbacks_is_wildcard(callback->name, callback->name_len)
+        || !filter(callback->name, context)) {
+      callbacks->callbacks[num_callbacks++] = *callback;
+      continue;
+    }
+
+    for (uint32_t j = 0; j < callback->num_handlers; j++)
+      callbacks_release(callbacks, callback->handlers[j].callback_ref);
+    if (callbacks_is_pattern(callback->event, callback->event_len))
+      callbacks->num_patterns--;
+    free(callback->handlers);
+    free(callback->name);
+    free(callback->event);
+  }
+
+  if (num_callbacks == callbacks->num_callbacks) return;
+  callbacks->num_callbacks = num_callbacks;
+  callbacks_rehash(callbacks, callbacks->slots_size);
+}
+
+// Appends the handler to the handlers of the item for the event
+static inline void callbacks_add(struct callbacks* callbacks, const char* name, const char* event, int callback_ref, bool wants_env) {
+  struct callback* callback = callbacks_get(callbacks, name, event);
+  if (callback->num_handlers == callback->handlers_size) {
+    callback->handlers_size = callback->handlers_size
+                              ? 2 * callback->handlers_size
+                              : 1;
+    callback->handlers = realloc(callback->handlers,
+                                 sizeof(struct callback_handler)
+                                 * callback->handlers_size);
+  }
+  callback->handlers[callback->num_handlers++] = (struct callback_handler) {
+    callback_ref, wants_env
+  };
+}
+
+static inline void callbacks_match_key(struct callbacks* callbacks, const char* name, uint32_t name_len, const char* event, uint32_t event_len, bool pattern) {
+  struct callback* callback = callbacks_find(callbacks, name, name_len,
+                                                        event, event_len,
+                                                        pattern          );
+  if (!callback) return;
+
+  uint32_t required = callbacks->num_matched + callback->num_handlers;
+  if (required > callbacks->matched_size) {
+    while (callbacks->matched_size < required) {
+      callbacks->matched_size = callbacks->matched_size
+                                ? 2 * callbacks->matched_size
+                                : 8;
+    }
+    callbacks->matched = realloc(callbacks->matched,
+                                 sizeof(struct callback_handler)
+                                 * callbacks->matched_size);
+  }
+  memcpy(callbacks->matched + callbacks->num_matched,
+         callback->handlers,
+         sizeof(struct callback_handler) * callback->num_handlers);
+  callbacks->num_matched = required;
+}
+
+static inline void callbacks_match_name(struct callbacks* callbacks, const char* name, uint32_t name_len, const char* event, uint32_t event_len) {
+  callbacks_match_key(callbacks, name, name_len, event, event_len, false);
+  if (!callbacks->num_patterns) return;
+
+  for (uint32_t i = event_len; i > 0; i--) {
+    if (event[i - 1] == '.')
+      callbacks_match_key(callbacks, name, name_len, event, i, true);
+  }
+  callbacks_match_key(callbacks, name, name_len, event, 0, true);
+}
+
+// Collects the handlers for the event of the item into `matched`, from the
+// most specific key to the most general one. The handlers are copied, such
+// that they can be called while new handlers are subscribed. The handlers of
+// the wildcard item are only included if `wildcard` is set.
+static inline uint32_t callbacks_match(struct callbacks* callbacks, const char* name, uint32_t name_len, const char* event, uint32_t event_len, bool wildcard) {
+  callbacks->num_matched = 0;
+  callbacks_match_name(callbacks, name, name_len, event, event_len);
+  if (wildcard
+      && callbacks->num_wildcard_names
+      && !callbacks_is_wildcard(name, name_len))
+    callbacks_match_name(callbacks, CALLBACKS_WILDCARD, 1, event, event_len);
+  return callbacks->num_matched;
+}
+
+static inline uint32_t* callback_names_slot(struct callback_names* names, const char* name, uint32_t hash) {
+  uint32_t mask = names->slots_size - 1;
+  for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+    uint32_t* slot = &names->slots[i];
+    if (!*slot) return slot;
+
+    struct callback_name* entry = &names->names[*slot - 1];
+    if (entry->hash == hash && strcmp(entry->name, name) == 0) return slot;
+  }
+}
+
+static inline void callback_names_rehash(struct callback_names* names, uint32_t slots_size) {
+  if (names->slots) free(names->slots);
+  names->slots_size = slots_size;
+  names->slots = calloc(slots_size, sizeof(uint32_t));
+  for (uint32_t i = 0; i < names->num_names; i++) {
+    *callback_names_slot(names, names->names[i].name,
+                                names->names[i].hash ) = i + 1;
+  }
+}
+
+static inline bool callback_names_contains(struct callback_names* names, const char* name, uint32_t name_len) {
+  if (!names->num_names) return false;
+
+  uint32_t hash = hash_fnv(HASH_SEED, name, name_len);
+  uint32_t mask = names->slots_size - 1;
+  for (uint32_t i = hash & mask; names->slots[i]; i = (i + 1) & mask) {
+    struct callback_name* entry = &names->names[names->slots[i] - 1];
+    if (entry->hash == hash
+        && strncmp(entry->name, name, name_len) == 0
+        && entry->name[name_len] == '\0') {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Adds the name to the set, returns false if it already was a member
+static inline bool callback_names_add(struct callback_names* names, const char* name) {
+  if (2 * (names->num_names + 1) > names->slots_size) {
+    callback_names_rehash(names, names->slots_size
+                                 ? 2 * names->slots_size
+                                 : CALLBACKS_INITIAL_SLOTS);
+  }
+
+  uint32_t hash = hash_fnv(HASH_SEED, name, strlen(name));
+  uint32_t* slot = callback_names_slot(names, name, hash);
+  if (*slot) return false;
+
+  if (names->num_names == names->names_size) {
+    names->names_size = names->names_size ? 2 * names->names_size
+                                          : CALLBACKS_INITIAL_SLOTS / 2;
+    names->names = realloc(names->names,
+                           sizeof(struct callback_name) * names->names_size);
+  }
+  struct callback_name* entry = &names->names[names->num_names];
+  entry->name = malloc(strlen(name) + 1);
+  memcpy(entry->name, name, strlen(name) + 1);
+  entry->hash = hash;
+  *slot = ++names->num_names;
+  return true;
+}
+
+// Removes all names selected by the filter, keeping the order of the others
+static inline void callback_names_remove(struct callback_names* names, callbacks_filter* filter, void* context) {
+  uint32_t num_names = 0;
+  for (uint32_t i = 0; i < names->num_names; i++) {
+    if (filter(names->names[i].name, context)) free(names->names[i].name);
+    else names->names[num_names++] = names->names[i];
+  }
+
+  if (num_names == names->num_names) return;
+  names->num_names = num_names;
+  callback_names_rehash(names, names->slots_size);
+}
@@ -0,0 +1,199 @@
+#pragma once
+#include "hash.h"
+#include "message.h"
+#include <stdbool.h>
+
+// Merges adjacent `--set` commands targeting the same item within a
+// transaction into a single command. Only directly adjacent commands are
+// merged, such that commands targeting other items keep their order, and
+// every other command (e.g. `--add`, `--animate`, `--remove`) as well as
+// `--set` commands with a regex target are never merged. Within a merged
+// command an assignment is only dropped if the same property is assigned an
+// absolute value later on, relative values (`toggle`) are always kept.
+
+#define COALESCE_NONE UINT32_MAX
+
+struct coalesce_command {
+  uint32_t first;
+  uint32_t count;
+  // The number of commands merged into this one including itself, zero if
+  // it is merged into a previous one
+  uint32_t run;
+};
+
+struct coalesce_slot {
+  const char* key;
+  uint32_t key_len;
+  uint32_t hash;
+  uint32_t value;
+  uint32_t stamp;
+};
+
+struct coalescer {
+  struct coalesce_command* commands;
+  uint32_t num_commands;
+  uint32_t commands_size;
+
+  struct coalesce_slot* slots;
+  uint32_t slots_size;
+  uint32_t stamp;
+};
+
+static inline void coalesce_clear(struct coalescer* coalescer) {
+  if (++coalescer->stamp == 0) {
+    memset(coalescer->slots, 0, sizeof(struct coalesce_slot)
+                                * coalescer->slots_size);
+    coalescer->stamp = 1;
+  }
+}
+
+// Returns the slot holding the key, or the free slot the key belongs in
+static inline struct coalesce_slot* coalesce_slot(struct coalescer* coalescer, const char* key, uint32_t key_len) {
+  uint32_t hash = hash_fnv(HASH_SEED, key, key_len);
+  uint32_t mask = coalescer->slots_size - 1;
+  for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+    struct coalesce_slot* slot = &coalescer->slots[i];
+    if (slot->stamp != coalescer->stamp) {
+      slot->key = key;
+      slot->key_len = key_len;
+      slot->hash = hash;
+      slot->value = COALESCE_NONE;
+      slot->stamp = coalescer->stamp;
+      return slot;
+    }
+    if (slot->hash == hash
+        && slot->key_len == key_len
+        && memcmp(slot->key, key, key_len) == 0) {
+      return slot;
+    }
+  }
+}
+
+static inline uint32_t coalesce_key_length(const char* property, uint32_t len) {
+  const char* separator = memchr(property, '=', len);
+  return separator ? separator - property : len;
+}
+
+static inline bool coalesce_is_set(struct message* message, struct coalesce_command* command) {
+  if (command->count < 2) return false;
+  if (strcmp(message_fragment(message, command->first), "--set") != 0)
+    return false;
+  return *message_fragment(message, command->first + 1) != '/';
+}
+
+static inline bool coalesce_same_item(struct message* message, struct coalesce_command* a, struct coalesce_command* b) {
+  return strcmp(message_fragment(message, a->first + 1),
+                message_fragment(message, b->first + 1)) == 0;
+}
+
+static inline void coalesce_prepare(struct coalescer* coalescer, struct message* message) {
+  coalescer->num_commands = 0;
+  if (coalescer->commands_size < message->num_fragments) {
+    coalescer->commands_size = message->num_fragments;
+    coalescer->commands = realloc(coalescer->commands,
+                                  sizeof(struct coalesce_command)
+                                  * coalescer->commands_size);
+  }
+
+  uint32_t slots_size = coalescer->slots_size ? coalescer->slots_size : 64;
+  while (slots_size < 2 * message->num_fragments) slots_size *= 2;
+  if (slots_size != coalescer->slots_size) {
+    free(coalescer->slots);
+    coalescer->slots = calloc(slots_size, sizeof(struct coalesce_slot));
+    coalescer->slots_size = slots_size;
+    coalescer->stamp = 0;
+  }
+}
+
+static inline void coalesce_append_fragments(struct message* message, struct message* source, uint32_t first, uint32_t count) {
+  for (uint32_t i = first; i < first + count; i++) {
+    message_push_lstring(message, message_fragment(source, i),
+                                  message_fragment_length(source, i));
+  }
+}
+
+// Writes the merged properties of the `run` commands starting at `head`
+static inline void coalesce_merge(struct coalescer* coalescer, struct message* transaction, struct coalesce_command* head, uint32_t run, struct message* out) {
+  // Record the last absolute assignment of every property key and only emit
+  // the assignments from there on
+  coalesce_clear(coalescer);
+  for (struct coalesce_command* member = head; member < head + run; member++) {
+    for (uint32_t k = member->first + 2; k < member->first + member->count;
+                                         k++) {
+      uint32_t len = message_fragment_length(transaction, k);
+      char* property = message_fragment(transaction, k);
+      uint32_t key_len = coalesce_key_length(property, len);
+      struct coalesce_slot* slot = coalesce_slot(coalescer, property, key_len);
+      if (key_len == len
+          || !message_value_is_relative(property + key_len + 1,
+                                        len - key_len - 1      )) {
+        slot->value = k;
+      }
+    }
+  }
+
+  coalesce_append_fragments(out, transaction, head->first, 2);
+  for (struct coalesce_command* member = head; member < head + run; member++) {
+    for (uint32_t k = member->first + 2; k < member->first + member->count;
+                                         k++) {
+      uint32_t len = message_fragment_length(transaction, k);
+      char* property = message_fragment(transaction, k);
+      struct coalesce_slot* slot
+                    = coalesce_slot(coalescer,
+                                    property,
+                                    coalesce_key_length(property, len));
+
+      if (slot->value == COALESCE_NONE || k >= slot->value)
+        message_push_lstring(out, property, len);
+    }
+  }
+}
+
+// Writes the coalesced transaction to `out`. Returns false (leaving `out`
+// untouched) if there is nothing to merge.
+static inline bool coalesce(struct coalescer* coalescer, struct message* transaction, struct message* out) {
+  if (transaction->num_fragments == 0) return false;
+  coalesce_prepare(coalescer, transaction);
+
+  for (uint32_t i = 0; i < transaction->num_fragments; i++) {
+    char* fragment = message_fragment(transaction, i);
+    if (coalescer->num_commands == 0
+        || (fragment[0] == '-' && fragment[1] == '-')) {
+      coalescer->commands[coalescer->num_commands++]
+                                      = (struct coalesce_command) { i, 1, 1 };
+    } else {
+      coalescer->commands[coalescer->num_commands - 1].count++;
+    }
+  }
+
+  // Count the runs of adjacent `--set` commands of the same item
+  bool merge = false;
+  struct coalesce_command* head = NULL;
+  for (uint32_t i = 0; i < coalescer->num_commands; i++) {
+    struct coalesce_command* command = &coalescer->commands[i];
+    if (!coalesce_is_set(transaction, command)) {
+      head = NULL;
+    } else if (head && coalesce_same_item(transaction, head, command)) {
+      head->run++;
+      command->run = 0;
+      merge = true;
+    } else {
+      head = command;
+    }
+  }
+
+  if (!merge) return false;
+
+  message_reset(out);
+  for (uint32_t i = 0; i < coalescer->num_commands; i++) {
+    struct coalesce_command* command = &coalescer->commands[i];
+    if (command->run == 1) {
+      coalesce_append_fragments(out, transaction, command->first,
+                                                  command->count);
+    } else if (command->run > 1) {
+      coalesce_merge(coalescer, transaction, command, command->run, out);
+    }
+  }
+
+  return true;
+}
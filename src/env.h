@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef char* env;
+
+// The env block of an event is a sequence of NUL terminated key value pairs
+// ended by an empty key. It is split once into this index, such that lookups
+// and iteration do not need to rescan the block.
+struct env_entry {
+  char* key;
+  uint32_t key_len;
+  char* value;
+  uint32_t value_len;
+};
+
+struct env_index {
+  struct env_entry* entries;
+  uint32_t num_entries;
+  uint32_t entries_size;
+};
+
+static inline void env_index_build(struct env_index* index, env env, size_t size) {
+  index->num_entries = 0;
+  char* end = env + size;
+  char* caret = env;
+  while (caret < end && *caret) {
+    char* key_end = memchr(caret, '\0', end - caret);
+    if (!key_end || key_end + 1 >= end) break;
+    char* value_end = memchr(key_end + 1, '\0', end - key_end - 1);
+    if (!value_end) break;
+
+    if (index->num_entries == index->entries_size) {
+      index->entries_size = index->entries_size ? 2 * index->entries_size : 16;
+      index->entries = realloc(index->entries,
+                               sizeof(struct env_entry)*index->entries_size);
+    }
+
+    index->entries[index->num_entries++] = (struct env_entry) {
+      caret, key_end - caret, key_end + 1, value_end - key_end - 1
+    };
+    caret = value_end + 1;
+  }
+}
+
+static inline struct env_entry* env_index_find(struct env_index* index, const char* key) {
+  uint32_t key_len = strlen(key);
+  for (uint32_t i = 0; i < index->num_entries; i++) {
+    struct env_entry* entry = &index->entries[i];
+    if (entry->key_len == key_len && memcmp(entry->key, key, key_len) == 0)
+      return entry;
+  }
+  return NULL;
+}
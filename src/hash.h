@@ -0,0 +1,81 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// FNV-1a, the hash of all tables of the module. Several keys are hashed as
+// one by passing the hash of the previous ones as the seed.
+
+#define HASH_SEED 2166136261u
+#define HASH_PRIME 16777619u
+
+static inline uint32_t hash_fnv(uint32_t hash, const char* key, uint32_t length) {
+  for (uint32_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)key[i];
+    hash *= HASH_PRIME;
+  }
+  return hash;
+}
+
+// An open addressing table of entries keyed by name, e.g. the state kept per
+// item. Entries are allocated by the table with the size of the struct
+// embedding `struct hash_entry` as its first member, and are never removed.
+
+#define HASH_TABLE_INITIAL_SIZE 64
+
+struct hash_entry {
+  char* name;
+  uint32_t hash;
+};
+
+struct hash_table {
+  struct hash_entry** entries;
+  uint32_t num_entries;
+  uint32_t entries_size;
+};
+
+static inline struct hash_entry** hash_table_slot(struct hash_table* table, const char* name, uint32_t hash) {
+  uint32_t mask = table->entries_size - 1;
+  for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+    struct hash_entry** slot = &table->entries[i];
+    if (!*slot || ((*slot)->hash == hash && strcmp((*slot)->name, name) == 0))
+      return slot;
+  }
+}
+
+// Returns the entry of the name, a new zeroed entry of `entry_size` bytes is
+// created if there is none and `create` is set
+static inline struct hash_entry* hash_table_get(struct hash_table* table, const char* name, size_t entry_size, bool create) {
+  if (!table->entries_size) {
+    if (!create) return NULL;
+    table->entries_size = HASH_TABLE_INITIAL_SIZE;
+    table->entries = calloc(table->entries_size, sizeof(struct hash_entry*));
+  }
+
+  uint32_t length = strlen(name);
+  uint32_t hash = hash_fnv(HASH_SEED, name, length);
+  struct hash_entry** slot = hash_table_slot(table, name, hash);
+  if (*slot || !create) return *slot;
+
+  if (2 * (table->num_entries + 1) > table->entries_size) {
+    struct hash_entry** entries = table->entries;
+    uint32_t entries_size = table->entries_size;
+    table->entries_size *= 2;
+    table->entries = calloc(table->entries_size, sizeof(struct hash_entry*));
+    for (uint32_t i = 0; i < entries_size; i++) {
+      if (entries[i]) *hash_table_slot(table, entries[i]->name,
+                                              entries[i]->hash ) = entries[i];
+    }
+    free(entries);
+    slot = hash_table_slot(table, name, hash);
+  }
+
+  struct hash_entry* entry = calloc(1, entry_size);
+  entry->name = malloc(length + 1);
+  memcpy(entry->name, name, length + 1);
+  entry->hash = hash;
+  *slot = entry;
+  table->num_entries++;
+  return entry;
+}
@@ -0,0 +1,1077 @@
+#include "json.h"
+#include "arena.h"
+#include "hash.h"
+#include "json_scan.h"
+#include "parsing.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A single pass JSON decoder which pushes the decoded values directly onto
+// the Lua stack while tokenizing, instead of building a document tree first.
+
+// Scratch memory of the decoder, reset once the current message is done
+static struct arena g_json_arena;
+
+struct json_parser {
+  lua_State* state;
+  const char* cursor;
+  const char* end;
+  uint32_t depth;
+
+  // The key cache of the state and its stack index while decoding, if set
+  struct json_keys* keys;
+  int keys_index;
+};
+
+static bool json_parse_value(struct json_parser* parser);
+
+static inline void json_skip_whitespace(struct json_parser* parser) {
+  // Most tokens are directly adjacent or separated by a single space
+  if (parser->cursor < parser->end && (unsigned char)*parser->cursor > 32)
+    return;
+  parser->cursor = json_whitespace_end(parser->cursor, parser->end);
+}
+
+static inline bool json_parse_literal(struct json_parser* parser, const char* literal, uint32_t length) {
+  if (parser->end - parser->cursor < length
+      || memcmp(parser->cursor, literal, length) != 0) {
+    return false;
+  }
+  parser->cursor += length;
+  return true;
+}
+
+static bool json_scan_number(struct json_parser* parser, double* number) {
+  char buffer[64];
+  uint32_t length = 0;
+  const char* cursor = parser->cursor;
+  while (cursor < parser->end && length < sizeof(buffer) - 1) {
+    char c = *cursor;
+    if ((c < '0' || c > '9') && c != '+' && c != '-'
+        && c != 'e' && c != 'E' && c != '.') {
+      break;
+    }
+    buffer[length++] = c;
+    cursor++;
+  }
+  buffer[length] = '\0';
+
+  char* after = NULL;
+  *number = strtod(buffer, &after);
+  if (after == buffer) return false;
+  parser->cursor += after - buffer;
+  return true;
+}
+
+// Plain integers are accumulated straight into a lua_Integer, only numbers
+// with a fraction or an exponent (or out of the integer range) are handed to
+// strtod. Those are still decoded as integers if their value is integral.
+static bool json_parse_number(struct json_parser* parser) {
+  const char* cursor = parser->cursor;
+  bool negative = *cursor == '-';
+  if (negative) cursor++;
+
+  const char* digits = cursor;
+  uint64_t value = 0;
+  while (cursor < parser->end
+         && *cursor >= '0' && *cursor <= '9'
+         && cursor - digits < 19               ) {
+    value = 10 * value + (*cursor - '0');
+    cursor++;
+  }
+
+  if (cursor > digits
+      && (cursor >= parser->end
+          || (*cursor != '.' && *cursor != 'e' && *cursor != 'E'
+              && (*cursor < '0' || *cursor > '9')                ))
+      && value <= (uint64_t)LUA_MAXINTEGER + negative              ) {
+    lua_pushinteger(parser->state, negative ? (lua_Integer)(0 - value)
+                                            : (lua_Integer)value      );
+    parser->cursor = cursor;
+    return true;
+  }
+
+  double number;
+  if (!json_scan_number(parser, &number)) return false;
+
+  lua_Integer integer;
+  if (lua_numbertointeger(number, &integer) && (lua_Number)integer == number)
+    lua_pushinteger(parser->state, integer);
+  else
+    lua_pushnumber(parser->state, number);
+  return true;
+}
+
+static bool json_parse_hex(const char* input, uint32_t* value) {
+  *value = 0;
+  for (int i = 0; i < 4; i++) {
+    char c = input[i];
+    *value <<= 4;
+    if (c >= '0' && c <= '9') *value += c - '0';
+    else if (c >= 'a' && c <= 'f') *value += c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F') *value += c - 'A' + 10;
+    else return false;
+  }
+  return true;
+}
+
+// Decodes the \uXXXX escape (and a trailing low surrogate) at `input` into
+// UTF-8, returns the number of input bytes consumed or zero on failure
+static uint32_t json_parse_utf16(const char* input, const char* end, char* out, uint32_t* out_length) {
+  uint32_t codepoint, low;
+  if (end - input < 6 || !json_parse_hex(input + 2, &codepoint)) return 0;
+  uint32_t consumed = 6;
+
+  if (codepoint >= 0xDC00 && codepoint <= 0xDFFF) return 0;
+  if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+    if (end - input < 12
+        || input[6] != '\\' || input[7] != 'u'
+        || !json_parse_hex(input + 8, &low)
+        || low < 0xDC00 || low > 0xDFFF) {
+      return 0;
+    }
+    codepoint = 0x10000 + (((codepoint & 0x3FF) << 10) | (low & 0x3FF));
+    consumed = 12;
+  }
+
+  if (codepoint < 0x80) {
+    out[0] = codepoint;
+    *out_length = 1;
+  } else if (codepoint < 0x800) {
+    out[0] = 0xC0 | (codepoint >> 6);
+    out[1] = 0x80 | (codepoint & 0x3F);
+    *out_length = 2;
+  } else if (codepoint < 0x10000) {
+    out[0] = 0xE0 | (codepoint >> 12);
+    out[1] = 0x80 | ((codepoint >> 6) & 0x3F);
+    out[2] = 0x80 | (codepoint & 0x3F);
+    *out_length = 3;
+  } else {
+    out[0] = 0xF0 | (codepoint >> 18);
+    out[1] = 0x80 | ((codepoint >> 12) & 0x3F);
+    out[2] = 0x80 | ((codepoint >> 6) & 0x3F);
+    out[3] = 0x80 | (codepoint & 0x3F);
+    *out_length = 4;
+  }
+  return consumed;
+}
+
+// Returns the closing quote of the string whose content starts at `cursor`
+static inline const char* json_string_end(const char* cursor, const char* end, bool* escaped) {
+  *escaped = false;
+  for (;;) {
+    cursor = json_find_special(cursor, end);
+    if (cursor >= end) return NULL;
+    if (*cursor == '"') return cursor;
+    *escaped = true;
+    cursor += 2;
+  }
+}
+
+// Writes the decoded string content to `out`, which needs to hold at least
+// `end - begin` bytes. Returns the decoded length or -1 on invalid escapes.
+static int64_t json_unescape(const char* begin, const char* end, char* out) {
+  char* start = out;
+  while (begin < end) {
+    if (*begin != '\\') {
+      const char* escape = memchr(begin, '\\', end - begin);
+      uint32_t length = (escape ? escape : end) - begin;
+      memcpy(out, begin, length);
+      out += length;
+      begin += length;
+      continue;
+    }
+
+    switch (begin[1]) {
+      case 'b': *out++ = '\b'; break;
+      case 'f': *out++ = '\f'; break;
+      case 'n': *out++ = '\n'; break;
+      case 'r': *out++ = '\r'; break;
+      case 't': *out++ = '\t'; break;
+      case '"':
+      case '\\':
+      case '/': *out++ = begin[1]; break;
+      case 'u': {
+        uint32_t length;
+        uint32_t consumed = json_parse_utf16(begin, end, out, &length);
+        if (!consumed) return -1;
+        out += length;
+        begin += consumed;
+        continue;
+      }
+      default: return -1;
+    }
+    begin += 2;
+  }
+  return out - start;
+}
+
+static bool json_parse_string(struct json_parser* parser) {
+  bool escaped;
+  const char* start = parser->cursor + 1;
+  const char* end = json_string_end(start, parser->end, &escaped);
+  if (!end) return false;
+
+  // Strings without escapes are pushed straight from the input
+  if (!escaped) {
+    lua_pushlstring(parser->state, start, end - start);
+    parser->cursor = end + 1;
+    return true;
+  }
+
+  char* out = arena_alloc(&g_json_arena, end - start);
+  int64_t length = json_unescape(start, end, out);
+  if (length < 0) return false;
+  lua_pushlstring(parser->state, out, length);
+  parser->cursor = end + 1;
+  return true;
+}
+
+// Object keys repeat across messages, the most frequent ones are kept
+// anchored and pushed from there instead of being hashed and interned (and
+// later collected) again for every message. Every state has a cache of its
+// own, a userdata in its registry whose user values hold the key strings.
+struct json_key {
+  uint32_t hash;
+  uint32_t length;
+  bool used;
+  char key[JSON_KEY_MAX_LENGTH];
+};
+
+struct json_keys {
+  struct json_key slots[JSON_KEY_CACHE_SIZE];
+  uint32_t num_keys;
+};
+
+// The address of this variable is the registry key of the cache
+static const char g_json_keys_key = 0;
+
+// Pushes the key cache of the state, creating it on first use
+static struct json_keys* json_keys_push(lua_State* state) {
+  if (lua_rawgetp(state, LUA_REGISTRYINDEX, &g_json_keys_key)
+      == LUA_TUSERDATA) {
+    return lua_touserdata(state, -1);
+  }
+  lua_pop(state, 1);
+
+  struct json_keys* keys = lua_newuserdatauv(state, sizeof(struct json_keys),
+                                                    JSON_KEY_CACHE_SIZE     );
+  memset(keys, 0, sizeof(struct json_keys));
+  lua_pushvalue(state, -1);
+  lua_rawsetp(state, LUA_REGISTRYINDEX, &g_json_keys_key);
+  return keys;
+}
+
+// Pushes the key using the cache at stack index `index`
+static void json_keys_push_key(lua_State* state, struct json_keys* keys, int index, const char* key, uint32_t length) {
+  if (length > JSON_KEY_MAX_LENGTH) {
+    lua_pushlstring(state, key, length);
+    return;
+  }
+
+  uint32_t hash = hash_fnv(HASH_SEED, key, length);
+  uint32_t mask = JSON_KEY_CACHE_SIZE - 1;
+  uint32_t i;
+  for (i = hash & mask;; i = (i + 1) & mask) {
+    struct json_key* slot = &keys->slots[i];
+    if (!slot->used) break;
+    if (slot->hash == hash
+        && slot->length == length
+        && memcmp(slot->key, key, length) == 0) {
+      lua_getiuservalue(state, index, i + 1);
+      return;
+    }
+  }
+
+  lua_pushlstring(state, key, length);
+
+  // The cache is bounded, later keys are simply pushed as they come
+  if (2 * keys->num_keys >= JSON_KEY_CACHE_SIZE) return;
+  lua_pushvalue(state, -1);
+  lua_setiuservalue(state, index, i + 1);
+  struct json_key* slot = &keys->slots[i];
+  slot->used = true;
+  slot->hash = hash;
+  slot->length = length;
+  memcpy(slot->key, key, length);
+  keys->num_keys++;
+}
+
+void json_push_key(lua_State* state, const char* key, uint32_t length) {
+  if (length > JSON_KEY_MAX_LENGTH) {
+    lua_pushlstring(state, key, length);
+    return;
+  }
+
+  struct json_keys* keys = json_keys_push(state);
+  json_keys_push_key(state, keys, lua_gettop(state), key, length);
+  lua_remove(state, -2);
+}
+
+static bool json_parse_key(struct json_parser* parser) {
+  bool escaped;
+  const char* start = parser->cursor + 1;
+  const char* end = json_string_end(start, parser->end, &escaped);
+  if (!end) return false;
+  if (escaped) return json_parse_string(parser);
+
+  if (parser->keys) {
+    json_keys_push_key(parser->state, parser->keys, parser->keys_index,
+                                      start,        end - start         );
+  } else {
+    json_push_key(parser->state, start, end - start);
+  }
+  parser->cursor = end + 1;
+  return true;
+}
+
+// Moves the `count` values (or key value pairs) buffered on top of the stack
+// into a table created with the exact size
+static inline void json_flush_array(lua_State* state, int count) {
+  lua_createtable(state, count, 0);
+  lua_insert(state, -count - 1);
+  for (int i = count; i > 0; i--) lua_rawseti(state, -i - 1, i);
+}
+
+static inline void json_flush_object(lua_State* state, int count, int records) {
+  lua_createtable(state, 0, records);
+  lua_insert(state, -2 * count - 1);
+  for (int i = 0; i < count; i++) lua_rawset(state, -2 * (count - i) - 1);
+}
+
+static bool json_parse_array(struct json_parser* parser) {
+  if (++parser->depth > JSON_MAX_DEPTH) return false;
+  if (!lua_checkstack(parser->state, JSON_TABLE_BATCH + 4)) return false;
+
+  parser->cursor++;
+  json_skip_whitespace(parser);
+  if (parser->cursor < parser->end && *parser->cursor == ']') {
+    lua_createtable(parser->state, 0, 0);
+    parser->cursor++;
+    parser->depth--;
+    return true;
+  }
+
+  // The first values are buffered on the stack until the size is known
+  int count = 0;
+  for (;;) {
+    json_skip_whitespace(parser);
+    if (!json_parse_value(parser)) return false;
+    if (++count == JSON_TABLE_BATCH) json_flush_array(parser->state, count);
+    else if (count > JSON_TABLE_BATCH) lua_rawseti(parser->state, -2, count);
+
+    json_skip_whitespace(parser);
+    if (parser->cursor >= parser->end) return false;
+    if (*parser->cursor == ']') break;
+    if (*parser->cursor != ',') return false;
+    parser->cursor++;
+  }
+
+  if (count < JSON_TABLE_BATCH) json_flush_array(parser->state, count);
+  parser->cursor++;
+  parser->depth--;
+  return true;
+}
+
+static bool json_parse_object(struct json_parser* parser) {
+  if (++parser->depth > JSON_MAX_DEPTH) return false;
+  if (!lua_checkstack(parser->state, 2 * JSON_TABLE_BATCH + 4)) return false;
+
+  parser->cursor++;
+  json_skip_whitespace(parser);
+  if (parser->cursor < parser->end && *parser->cursor == '}') {
+    lua_createtable(parser->state, 0, 0);
+    parser->cursor++;
+    parser->depth--;
+    return true;
+  }
+
+  // The first pairs are buffered on the stack until the size is known, null
+  // values do not occupy a slot in the table
+  int count = 0, records = 0;
+  for (;;) {
+    json_skip_whitespace(parser);
+    if (parser->cursor >= parser->end || *parser->cursor != '"') return false;
+    if (!json_parse_key(parser)) return false;
+
+    json_skip_whitespace(parser);
+    if (parser->cursor >= parser->end || *parser->cursor != ':') return false;
+    parser->cursor++;
+
+    json_skip_whitespace(parser);
+    if (!json_parse_value(parser)) return false;
+    if (!lua_isnil(parser->state, -1)) records++;
+    if (++count == JSON_TABLE_BATCH)
+      json_flush_object(parser->state, count, records);
+    else if (count > JSON_TABLE_BATCH)
+      lua_rawset(parser->state, -3);
+
+    json_skip_whitespace(parser);
+    if (parser->cursor >= parser->end) return false;
+    if (*parser->cursor == '}') break;
+    if (*parser->cursor != ',') return false;
+    parser->cursor++;
+  }
+
+  if (count < JSON_TABLE_BATCH)
+    json_flush_object(parser->state, count, records);
+  parser->cursor++;
+  parser->depth--;
+  return true;
+}
+
+static bool json_parse_value(struct json_parser* parser) {
+  if (parser->cursor >= parser->end) return false;
+
+  switch (*parser->cursor) {
+    case '{': return json_parse_object(parser);
+    case '[': return json_parse_array(parser);
+    case '"': return json_parse_string(parser);
+    case 'n':
+      if (!json_parse_literal(parser, "null", 4)) return false;
+      lua_pushnil(parser->state);
+      return true;
+    case 't':
+      if (!json_parse_literal(parser, "true", 4)) return false;
+      lua_pushboolean(parser->state, true);
+      return true;
+    case 'f':
+      if (!json_parse_literal(parser, "false", 5)) return false;
+      lua_pushboolean(parser->state, false);
+      return true;
+    default:
+      if (*parser->cursor == '-'
+          || (*parser->cursor >= '0' && *parser->cursor <= '9')) {
+        return json_parse_number(parser);
+      }
+      return false;
+  }
+}
+
+static bool json_valid_escapes(const char* begin, const char* end) {
+  char utf8[4];
+  uint32_t length;
+  while ((begin = memchr(begin, '\\', end - begin))) {
+    if (begin[1] == 'u') {
+      uint32_t consumed = json_parse_utf16(begin, end, utf8, &length);
+      if (!consumed) return false;
+      begin += consumed;
+    } else if (begin[1] && strchr("bfnrt\"\\/", begin[1])) {
+      begin += 2;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Validates the value at the cursor and moves past it without decoding it
+static bool json_skip_value(struct json_parser* parser) {
+  if (parser->cursor >= parser->end) return false;
+
+  char c = *parser->cursor;
+  if (c == '{' || c == '[') {
+    char close = c == '{' ? '}' : ']';
+    if (++parser->depth > JSON_MAX_DEPTH) return false;
+
+    parser->cursor++;
+    json_skip_whitespace(parser);
+    if (parser->cursor < parser->end && *parser->cursor == close) {
+      parser->cursor++;
+      parser->depth--;
+      return true;
+    }
+
+    for (;;) {
+      json_skip_whitespace(parser);
+      if (c == '{') {
+        if (parser->cursor >= parser->end || *parser->cursor != '"') return false;
+        if (!json_skip_value(parser)) return false;
+
+        json_skip_whitespace(parser);
+        if (parser->cursor >= parser->end || *parser->cursor != ':') return false;
+        parser->cursor++;
+        json_skip_whitespace(parser);
+      }
+
+      if (!json_skip_value(parser)) return false;
+
+      json_skip_whitespace(parser);
+      if (parser->cursor >= parser->end) return false;
+      if (*parser->cursor == close) break;
+      if (*parser->cursor != ',') return false;
+      parser->cursor++;
+    }
+
+    parser->cursor++;
+    parser->depth--;
+    return true;
+  }
+
+  switch (c) {
+    case '"': {
+      bool escaped;
+      const char* end = json_string_end(parser->cursor + 1, parser->end,
+                                                            &escaped    );
+      if (!end) return false;
+      if (escaped && !json_valid_escapes(parser->cursor + 1, end))
+        return false;
+      parser->cursor = end + 1;
+      return true;
+    }
+    case 'n': return json_parse_literal(parser, "null", 4);
+    case 't': return json_parse_literal(parser, "true", 4);
+    case 'f': return json_parse_literal(parser, "false", 5);
+    default: {
+      double number;
+      if (c != '-' && (c < '0' || c > '9')) return false;
+      return json_scan_number(parser, &number);
+    }
+  }
+}
+
+// Skips a leading byte order mark and whitespace
+static inline const char* json_document_begin(const char* json, const char* end) {
+  if (end - json >= 3 && memcmp(json, "\xEF\xBB\xBF", 3) == 0) json += 3;
+  return json_whitespace_end(json, end);
+}
+
+// Returns the position after the object or array at `json` by matching its
+// brackets outside of strings, without validating anything else. Returns
+// NULL if the brackets do not match up before `end`.
+const char* json_document_end(const char* json, const char* end) {
+  uint32_t depth = 0;
+  const char* cursor = json;
+  while (cursor < end) {
+    char c = *cursor++;
+    if (c == '"') {
+      bool escaped;
+      cursor = json_string_end(cursor, end, &escaped);
+      if (!cursor) return NULL;
+      cursor++;
+    } else if (c == '{' || c == '[') {
+      depth++;
+    } else if (c == '}' || c == ']') {
+      if (depth == 0) return NULL;
+      if (--depth == 0) return cursor;
+    }
+  }
+  return NULL;
+}
+
+// Cheaply rules out values which can not be a JSON object or array, without
+// looking beyond the first JSON_SNIFF_LENGTH bytes after the opening bracket.
+// A true result only means that the value may be JSON.
+bool json_sniff(const char* json, const char* end) {
+  const char* cursor = json_document_begin(json, end);
+  if (cursor >= end || (*cursor != '{' && *cursor != '[')) return false;
+
+  char open = *cursor++;
+  if (end - cursor > JSON_SNIFF_LENGTH) end = cursor + JSON_SNIFF_LENGTH;
+  cursor = json_whitespace_end(cursor, end);
+  if (cursor >= end) return true;
+
+  if (open == '[') return *cursor && strchr("{[\"-0123456789tfn]", *cursor);
+  if (*cursor == '}') return true;
+  if (*cursor != '"') return false;
+
+  // The first key has to be followed by a colon
+  bool escaped;
+  cursor = json_string_end(cursor + 1, end, &escaped);
+  if (!cursor) return true;
+  cursor = json_whitespace_end(cursor + 1, end);
+  return cursor >= end || *cursor == ':';
+}
+
+// Decodes the JSON object or array at the start of the buffer and pushes it
+// as a table. Returns the position after the decoded document, or NULL if
+// it is not valid JSON, in which case nothing is pushed.
+const char* json_decode(lua_State* state, const char* json, const char* end) {
+  int top = lua_gettop(state);
+  struct json_parser parser = { state, json_document_begin(json, end),
+                                end,   0,
+                                json_keys_push(state), top + 1         };
+
+  if (parser.cursor >= end
+      || (*parser.cursor != '{' && *parser.cursor != '[')
+      || !json_parse_value(&parser)                       ) {
+    lua_settop(state, top);
+    return NULL;
+  }
+
+  lua_remove(state, parser.keys_index);
+  return parser.cursor;
+}
+
+bool json_to_lua_table(lua_State* state, const char* json_str) {
+  return json_decode(state, json_str, json_str + strlen(json_str)) != NULL;
+}
+
+void json_arena_reset(void) {
+  arena_reset(&g_json_arena);
+}
+
+// A lazy document keeps the raw response and only indexes an object (or
+// array) once it is first accessed. Nested objects are handed out as proxies
+// of their own, which share the buffer of the root proxy. The first user
+// value of every proxy caches the values decoded so far, the second one
+// keeps the root proxy (and thus the buffer) alive.
+
+struct json_lazy_entry {
+  const char* key;
+  uint32_t key_len;
+  uint32_t hash;
+  bool owns_key;
+  // A later entry has the same key and replaces this one, as it would in a
+  // decoded table
+  bool shadowed;
+  const char* value;
+};
+
+struct json_lazy {
+  char* buffer;
+  const char* begin;
+  const char* end;
+
+  struct json_lazy_entry* entries;
+  uint32_t num_entries;
+  bool indexed;
+
+  // Open addressing table of the keys of an object, every slot holds the
+  // entry index + 1 or 0 if it is free
+  uint32_t* slots;
+  uint32_t slots_mask;
+};
+
+static inline bool json_lazy_entry_is(struct json_lazy_entry* entry, uint32_t hash, const char* key, uint32_t length) {
+  return entry->hash == hash
+         && entry->key_len == length
+         && memcmp(entry->key, key, length) == 0;
+}
+
+static void json_lazy_hash(struct json_lazy* lazy) {
+  uint32_t size = 16;
+  while (size < 2 * lazy->num_entries) size *= 2;
+  lazy->slots = calloc(size, sizeof(uint32_t));
+  lazy->slots_mask = size - 1;
+
+  for (uint32_t i = 0; i < lazy->num_entries; i++) {
+    struct json_lazy_entry* entry = &lazy->entries[i];
+    entry->hash = hash_fnv(HASH_SEED, entry->key, entry->key_len);
+
+    uint32_t* slot;
+    for (uint32_t j = entry->hash & lazy->slots_mask;;
+                  j = (j + 1) & lazy->slots_mask   ) {
+      slot = &lazy->slots[j];
+      if (!*slot) break;
+      struct json_lazy_entry* other = &lazy->entries[*slot - 1];
+      if (json_lazy_entry_is(other, entry->hash, entry->key, entry->key_len)) {
+        other->shadowed = true;
+        break;
+      }
+    }
+    *slot = i + 1;
+  }
+}
+
+static void json_lazy_index(struct json_lazy* lazy) {
+  lazy->indexed = true;
+  bool object = *lazy->begin == '{';
+  uint32_t entries_size = 0;
+  struct json_parser parser = { NULL, lazy->begin + 1, lazy->end, 0, NULL, 0 };
+
+  // The document has been validated upon creation of the root proxy
+  for (;;) {
+    json_skip_whitespace(&parser);
+    if (*parser.cursor == '}' || *parser.cursor == ']') break;
+
+    struct json_lazy_entry entry = { 0 };
+    if (object) {
+      bool escaped;
+      const char* key = parser.cursor + 1;
+      const char* key_end = json_string_end(key, parser.end, &escaped);
+      if (escaped) {
+        char* decoded = malloc(key_end - key);
+        entry.key_len = json_unescape(key, key_end, decoded);
+        entry.key = decoded;
+        entry.owns_key = true;
+      } else {
+        entry.key = key;
+        entry.key_len = key_end - key;
+      }
+
+      parser.cursor = key_end + 1;
+      json_skip_whitespace(&parser);
+      parser.cursor++;
+      json_skip_whitespace(&parser);
+    }
+
+    entry.value = parser.cursor;
+    json_skip_value(&parser);
+
+    if (lazy->num_entries == entries_size) {
+      entries_size = entries_size ? 2 * entries_size : 16;
+      lazy->entries = realloc(lazy->entries, sizeof(struct json_lazy_entry)
+                                             * entries_size             );
+    }
+    lazy->entries[lazy->num_entries++] = entry;
+
+    json_skip_whitespace(&parser);
+    if (*parser.cursor != ',') break;
+    parser.cursor++;
+  }
+
+  if (object) json_lazy_hash(lazy);
+}
+
+static void json_lazy_new(lua_State* state, char* buffer, const char* begin, const char* end) {
+  struct json_lazy* lazy = lua_newuserdatauv(state, sizeof(struct json_lazy),
+                                                    2                      );
+  memset(lazy, 0, sizeof(struct json_lazy));
+  lazy->buffer = buffer;
+  lazy->begin = begin;
+  lazy->end = end;
+
+  luaL_setmetatable(state, JSON_LAZY_METATABLE);
+  lua_newtable(state);
+  lua_setiuservalue(state, -2, 1);
+}
+
+// Pushes the value of the entry, nested objects and arrays are pushed as
+// proxies and all decoded values are cached
+static void json_lazy_push_entry(lua_State* state, int index, struct json_lazy* lazy, uint32_t entry_index) {
+  struct json_lazy_entry* entry = &lazy->entries[entry_index];
+  index = lua_absindex(state, index);
+
+  lua_getiuservalue(state, index, 1);
+  if (*lazy->begin == '{')
+    json_push_key(state, entry->key, entry->key_len);
+  else
+    lua_pushinteger(state, entry_index + 1);
+
+  lua_pushvalue(state, -1);
+  if (lua_rawget(state, -3) != LUA_TNIL) {
+    lua_replace(state, -3);
+    lua_pop(state, 1);
+    return;
+  }
+  lua_pop(state, 1);
+
+  if (*entry->value == '{' || *entry->value == '[') {
+    json_lazy_new(state, NULL, entry->value, lazy->end);
+    if (lazy->buffer) lua_pushvalue(state, index);
+    else lua_getiuservalue(state, index, 2);
+    lua_setiuservalue(state, -2, 2);
+  } else {
+    struct json_parser parser = { state, entry->value, lazy->end, 0, NULL, 0 };
+    json_parse_value(&parser);
+    arena_reset(&g_json_arena);
+  }
+
+  lua_pushvalue(state, -2);
+  lua_pushvalue(state, -2);
+  lua_rawset(state, -5);
+  lua_replace(state, -3);
+  lua_pop(state, 1);
+}
+
+static int json_lazy_find(lua_State* state, struct json_lazy* lazy, int key) {
+  if (!lazy->indexed) json_lazy_index(lazy);
+
+  if (*lazy->begin == '[') {
+    int valid;
+    lua_Integer position = lua_tointegerx(state, key, &valid);
+    if (!valid || lua_type(state, key) != LUA_TNUMBER
+        || position < 1 || position > lazy->num_entries) return -1;
+    return position - 1;
+  }
+
+  if (lua_type(state, key) != LUA_TSTRING) return -1;
+  size_t length;
+  const char* name = lua_tolstring(state, key, &length);
+  uint32_t hash = hash_fnv(HASH_SEED, name, length);
+  for (uint32_t i = hash & lazy->slots_mask;; i = (i + 1) & lazy->slots_mask) {
+    uint32_t slot = lazy->slots[i];
+    if (!slot) return -1;
+    if (json_lazy_entry_is(&lazy->entries[slot - 1], hash, name, length))
+      return slot - 1;
+  }
+}
+
+static int json_lazy_index_metamethod(lua_State* state) {
+  struct json_lazy* lazy = luaL_checkudata(state, 1, JSON_LAZY_METATABLE);
+
+  // Values which have been decoded before are served from the cache
+  lua_getiuservalue(state, 1, 1);
+  lua_pushvalue(state, 2);
+  if (lua_rawget(state, -2) != LUA_TNIL) return 1;
+  lua_pop(state, 2);
+
+  int entry = json_lazy_find(state, lazy, 2);
+  if (entry < 0) return 0;
+  json_lazy_push_entry(state, 1, lazy, entry);
+  return 1;
+}
+
+static int json_lazy_next(lua_State* state) {
+  struct json_lazy* lazy = luaL_checkudata(state, 1, JSON_LAZY_METATABLE);
+  lua_Integer position = lua_tointeger(state, lua_upvalueindex(1));
+
+  for (; position < lazy->num_entries; position++) {
+    if (*lazy->entries[position].value == 'n'
+        || lazy->entries[position].shadowed) continue;
+
+    lua_pushinteger(state, position + 1);
+    lua_replace(state, lua_upvalueindex(1));
+    if (*lazy->begin == '{') {
+      json_push_key(state, lazy->entries[position].key,
+                           lazy->entries[position].key_len);
+    } else {
+      lua_pushinteger(state, position + 1);
+    }
+    json_lazy_push_entry(state, 1, lazy, position);
+    return 2;
+  }
+  return 0;
+}
+
+static int json_lazy_pairs(lua_State* state) {
+  struct json_lazy* lazy = luaL_checkudata(state, 1, JSON_LAZY_METATABLE);
+  if (!lazy->indexed) json_lazy_index(lazy);
+
+  lua_pushinteger(state, 0);
+  lua_pushcclosure(state, json_lazy_next, 1);
+  lua_pushvalue(state, 1);
+  lua_pushnil(state);
+  return 3;
+}
+
+static int json_lazy_len(lua_State* state) {
+  struct json_lazy* lazy = luaL_checkudata(state, 1, JSON_LAZY_METATABLE);
+  if (!lazy->indexed) json_lazy_index(lazy);
+  lua_pushinteger(state, *lazy->begin == '[' ? lazy->num_entries : 0);
+  return 1;
+}
+
+static int json_lazy_gc(lua_State* state) {
+  struct json_lazy* lazy = luaL_checkudata(state, 1, JSON_LAZY_METATABLE);
+  for (uint32_t i = 0; i < lazy->num_entries; i++) {
+    if (lazy->entries[i].owns_key) free((char*)lazy->entries[i].key);
+  }
+  if (lazy->entries) free(lazy->entries);
+  if (lazy->slots) free(lazy->slots);
+  if (lazy->buffer) free(lazy->buffer);
+  memset(lazy, 0, sizeof(struct json_lazy));
+  return 0;
+}
+
+void json_lazy_register(lua_State* state) {
+  luaL_newmetatable(state, JSON_LAZY_METATABLE);
+  lua_pushcfunction(state, json_lazy_index_metamethod);
+  lua_setfield(state, -2, "__index");
+  lua_pushcfunction(state, json_lazy_pairs);
+  lua_setfield(state, -2, "__pairs");
+  lua_pushcfunction(state, json_lazy_len);
+  lua_setfield(state, -2, "__len");
+  lua_pushcfunction(state, json_lazy_gc);
+  lua_setfield(state, -2, "__gc");
+  lua_pop(state, 1);
+}
+
+// Pushes a lazy proxy taking ownership of the (malloced) JSON document.
+// Returns false if it is not a valid JSON object or array.
+bool json_lazy_push(lua_State* state, char* json) {
+  const char* end = json + strlen(json);
+  struct json_parser parser = { state, json_document_begin(json, end),
+                                end,   0,                      NULL, 0 };
+
+  const char* begin = parser.cursor;
+  if (begin >= end
+      || (*begin != '{' && *begin != '[')
+      || !json_skip_value(&parser)      ) {
+    free(json);
+    return false;
+  }
+
+  json_lazy_new(state, json, begin, end);
+  return true;
+}
+
+// The encoder writes Lua values straight into a message buffer. Tables are
+// encoded as arrays if their keys are exactly 1..n and as objects otherwise,
+// tables which are currently being encoded are tracked to detect cycles.
+
+struct json_encoder {
+  lua_State* state;
+  struct message* out;
+  const void** path;
+  uint32_t depth;
+};
+
+static bool json_encode_value(struct json_encoder* encoder, int index);
+
+// Writes the shortest of the "%.15g" to "%.17g" representations which reads
+// back as the same value, with a trailing ".0" for integral values such that
+// they are decoded as floats again
+static void json_encode_float(struct message* out, lua_Number value) {
+  char number[32];
+  int length = 0;
+  for (int precision = 15; precision <= 17; precision++) {
+    length = snprintf(number, sizeof(number), "%.*g", precision, value);
+    if (strtod(number, NULL) == value) break;
+  }
+
+  message_append(out, number, length);
+  if (number[strspn(number, "-0123456789")] == '\0')
+    message_append(out, ".0", 2);
+}
+
+static void json_encode_string(struct message* out, const char* string, size_t length) {
+  static const char hex[] = "0123456789abcdef";
+
+  message_append(out, "\"", 1);
+  const char* run = string;
+  for (size_t i = 0; i < length; i++) {
+    unsigned char c = string[i];
+    if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+    message_append(out, run, string + i - run);
+    run = string + i + 1;
+    switch (c) {
+      case '"': message_append(out, "\\\"", 2); break;
+      case '\\': message_append(out, "\\\\", 2); break;
+      case '\b': message_append(out, "\\b", 2); break;
+      case '\f': message_append(out, "\\f", 2); break;
+      case '\n': message_append(out, "\\n", 2); break;
+      case '\r': message_append(out, "\\r", 2); break;
+      case '\t': message_append(out, "\\t", 2); break;
+      default: {
+        char escape[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+        message_append(out, escape, sizeof(escape));
+      }
+    }
+  }
+  message_append(out, run, string + length - run);
+  message_append(out, "\"", 1);
+}
+
+static bool json_encode_table(struct json_encoder* encoder, int index) {
+  lua_State* state = encoder->state;
+  const void* table = lua_topointer(state, index);
+  for (uint32_t i = 0; i < encoder->depth; i++) {
+    if (encoder->path[i] == table) {
+      printf("[Lua] Error: can not encode a cyclic table as JSON\n");
+      return false;
+    }
+  }
+
+  if (encoder->depth == JSON_MAX_DEPTH || !lua_checkstack(state, 4)) {
+    printf("[Lua] Error: table nested too deeply to be encoded as JSON\n");
+    return false;
+  }
+  encoder->path[encoder->depth++] = table;
+
+  lua_Integer count = 0, max = 0;
+  bool array = true;
+  lua_pushnil(state);
+  while (lua_next(state, index)) {
+    lua_pop(state, 1);
+    count++;
+    if (array && lua_isinteger(state, -1) && lua_tointeger(state, -1) > 0) {
+      lua_Integer key = lua_tointeger(state, -1);
+      if (key > max) max = key;
+    } else {
+      array = false;
+    }
+  }
+
+  if (array && count > 0 && max == count) {
+    message_append(encoder->out, "[", 1);
+    for (lua_Integer i = 1; i <= count; i++) {
+      if (i > 1) message_append(encoder->out, ",", 1);
+      lua_rawgeti(state, index, i);
+      if (!json_encode_value(encoder, lua_gettop(state))) return false;
+      lua_pop(state, 1);
+    }
+    message_append(encoder->out, "]", 1);
+    encoder->depth--;
+    return true;
+  }
+
+  bool first = true;
+  message_append(encoder->out, "{", 1);
+  lua_pushnil(state);
+  while (lua_next(state, index)) {
+    int key_type = lua_type(state, -2);
+    if (key_type != LUA_TSTRING && key_type != LUA_TNUMBER) {
+      printf("[Lua] Error: can not encode a table key of type '%s' as JSON\n",
+             lua_typename(state, key_type)                                   );
+      return false;
+    }
+
+    if (!first) message_append(encoder->out, ",", 1);
+    first = false;
+
+    // Numeric keys are converted on a copy, lua_next needs the original
+    size_t key_len;
+    lua_pushvalue(state, -2);
+    const char* key = lua_tolstring(state, -1, &key_len);
+    json_encode_string(encoder->out, key, key_len);
+    lua_pop(state, 1);
+
+    message_append(encoder->out, ":", 1);
+    if (!json_encode_value(encoder, lua_gettop(state))) return false;
+    lua_pop(state, 1);
+  }
+  message_append(encoder->out, "}", 1);
+  encoder->depth--;
+  return true;
+}
+
+static bool json_encode_value(struct json_encoder* encoder, int index) {
+  lua_State* state = encoder->state;
+  switch (lua_type(state, index)) {
+    case LUA_TNIL:
+      message_append(encoder->out, "null", 4);
+      return true;
+    case LUA_TBOOLEAN:
+      if (lua_toboolean(state, index)) message_append(encoder->out, "true", 4);
+      else message_append(encoder->out, "false", 5);
+      return true;
+    case LUA_TNUMBER:
+      if (lua_isinteger(state, index))
+        parse_value(state, index, PROPERTY_UNKNOWN, encoder->out);
+      // JSON has no representation for nan and inf
+      else if (!isfinite(lua_tonumber(state, index)))
+        message_append(encoder->out, "null", 4);
+      else
+        json_encode_float(encoder->out, lua_tonumber(state, index));
+      return true;
+    case LUA_TSTRING: {
+      size_t length;
+      const char* string = lua_tolstring(state, index, &length);
+      json_encode_string(encoder->out, string, length);
+      return true;
+    }
+    case LUA_TTABLE:
+      return json_encode_table(encoder, index);
+    default:
+      printf("[Lua] Error: can not encode a value of type '%s' as JSON\n",
+             luaL_typename(state, index)                                 );
+      return false;
+  }
+}
+
+// Appends the JSON encoding of the value at `index` to the message. On
+// failure an error is printed and the message holds a partial encoding.
+bool json_encode(lua_State* state, int index, struct message* out) {
+  const void* path[JSON_MAX_DEPTH];
+  struct json_encoder encoder = { state, out, path, 0 };
+
+  int top = lua_gettop(state);
+  bool success = json_encode_value(&encoder, lua_absindex(state, index));
+  lua_settop(state, top);
+  return success;
+}
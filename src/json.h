@@ -0,0 +1,38 @@
+#pragma once
+#include <lua.h>
+#include <lauxlib.h>
+#include "message.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The maximum nesting depth of decoded JSON documents
+#ifndef JSON_MAX_DEPTH
+#define JSON_MAX_DEPTH 1000
+#endif
+
+// The number of values buffered on the Lua stack to size a table exactly,
+// larger tables grow as usual beyond this
+#ifndef JSON_TABLE_BATCH
+#define JSON_TABLE_BATCH 128
+#endif
+
+// The number of bytes json_sniff looks at after the opening bracket
+#define JSON_SNIFF_LENGTH 64
+
+// Object keys up to this length are cached, see json_push_key
+#define JSON_KEY_MAX_LENGTH 32
+#define JSON_KEY_CACHE_SIZE 512
+
+#define JSON_LAZY_METATABLE "sketchybar.json"
+
+const char* json_decode(lua_State* state, const char* json, const char* end);
+bool json_sniff(const char* json, const char* end);
+const char* json_document_end(const char* json, const char* end);
+bool json_to_lua_table(lua_State* state, const char* json_str);
+void json_arena_reset(void);
+void json_push_key(lua_State* state, const char* key, uint32_t length);
+bool json_encode(lua_State* state, int index, struct message* out);
+
+void json_lazy_register(lua_State* state);
+bool json_lazy_push(lua_State* state, char* json);
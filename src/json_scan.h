@@ -0,0 +1,90 @@
+#pragma once
+#include <stdint.h>
+
+#if !defined(JSON_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define JSON_SIMD_WIDTH 16
+#elif !defined(JSON_NO_SIMD) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define JSON_SIMD_WIDTH 16
+#endif
+
+// The scanners of the JSON decoder, which skip whitespace and the content of
+// strings 16 bytes at a time with SSE2 or NEON, and byte by byte for the
+// remaining tail or without SIMD (or if JSON_NO_SIMD is defined).
+
+#ifdef JSON_SIMD_WIDTH
+// Both return the offset of the first matching byte within the 16 bytes at
+// `block`, or 16 if there is none: the first quote or backslash, and the
+// first byte which is not whitespace (any byte above 32)
+#if defined(__SSE2__)
+static inline uint32_t json_simd_find_special(const char* block) {
+  __m128i bytes = _mm_loadu_si128((const __m128i*)block);
+  __m128i special = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('"')),
+                                 _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\\')));
+  uint32_t mask = _mm_movemask_epi8(special);
+  return mask ? __builtin_ctz(mask) : JSON_SIMD_WIDTH;
+}
+
+static inline uint32_t json_simd_find_nonspace(const char* block) {
+  __m128i bytes = _mm_loadu_si128((const __m128i*)block);
+  __m128i nonspace = _mm_cmpeq_epi8(_mm_max_epu8(bytes, _mm_set1_epi8(33)),
+                                    bytes                                 );
+  uint32_t mask = _mm_movemask_epi8(nonspace);
+  return mask ? __builtin_ctz(mask) : JSON_SIMD_WIDTH;
+}
+#else
+// NEON lacks a movemask, narrowing the comparison result yields four bits
+// per byte instead
+static inline uint32_t json_simd_first(uint8x16_t matches) {
+  uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(matches), 4);
+  uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+  return mask ? __builtin_ctzll(mask) >> 2 : JSON_SIMD_WIDTH;
+}
+
+static inline uint32_t json_simd_find_special(const char* block) {
+  uint8x16_t bytes = vld1q_u8((const uint8_t*)block);
+  return json_simd_first(vorrq_u8(vceqq_u8(bytes, vdupq_n_u8('"')),
+                                  vceqq_u8(bytes, vdupq_n_u8('\\'))));
+}
+
+static inline uint32_t json_simd_find_nonspace(const char* block) {
+  uint8x16_t bytes = vld1q_u8((const uint8_t*)block);
+  return json_simd_first(vcgtq_u8(bytes, vdupq_n_u8(32)));
+}
+#endif
+#endif
+
+static inline const char* json_scalar_whitespace_end(const char* cursor, const char* end) {
+  while (cursor < end && (unsigned char)*cursor <= 32) cursor++;
+  return cursor;
+}
+
+static inline const char* json_scalar_find_special(const char* cursor, const char* end) {
+  while (cursor < end && *cursor != '"' && *cursor != '\\') cursor++;
+  return cursor;
+}
+
+// Returns the position of the first byte which is not whitespace
+static inline const char* json_whitespace_end(const char* cursor, const char* end) {
+#ifdef JSON_SIMD_WIDTH
+  while (end - cursor >= JSON_SIMD_WIDTH) {
+    uint32_t offset = json_simd_find_nonspace(cursor);
+    cursor += offset;
+    if (offset < JSON_SIMD_WIDTH) return cursor;
+  }
+#endif
+  return json_scalar_whitespace_end(cursor, end);
+}
+
+// Returns the position of the next quote or backslash
+static inline const char* json_find_special(const char* cursor, const char* end) {
+#ifdef JSON_SIMD_WIDTH
+  while (end - cursor >= JSON_SIMD_WIDTH) {
+    uint32_t offset = json_simd_find_special(cursor);
+    cursor += offset;
+    if (offset < JSON_SIMD_WIDTH) return cursor;
+  }
+#endif
+  return json_scalar_find_special(cursor, end);
+}
@@ -2,12 +2,12 @@
 #include <mach/message.h>
 #include <bootstrap.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <CoreFoundation/CoreFoundation.h>
-
-typedef char* env;
+#include "env.h"
 
 #define MACH_HANDLER(name) void name(char* message, size_t size)
 typedef MACH_HANDLER(mach_handler);
@@ -30,44 +30,9 @@ struct mach_server {
   mach_handler* handler;
 };
 
-struct key_value_pair {
-  char* key;
-  char* value;
-};
-
 static struct mach_server g_mach_server;
 static mach_port_t g_mach_port = 0;
 
-static inline char* env_get_value_for_key(env env, char* key) {
-  uint32_t caret = 0;
-  for(;;) {
-    if (!env[caret]) break;
-    if (strcmp(&env[caret], key) == 0)
-      return &env[caret + strlen(&env[caret]) + 1];
-
-    caret += strlen(&env[caret])
-             + strlen(&env[caret + strlen(&env[caret]) + 1])
-             + 2;
-  }
-  return (char*)"";
-}
-
-static inline struct key_value_pair env_get_next_key_value_pair(env env, struct key_value_pair prev) {
-  uint32_t caret = 0;
-  if (prev.key != NULL) {
-    caret = (prev.key - env) + strlen(&env[(prev.key - env)])
-                             + strlen(&env[(prev.key - env)
-                                      + strlen(&env[(prev.key - env)])
-                                      + 1                             ])
-                             + 2;
-  }
-
-  if (!env[caret]) return (struct key_value_pair) { NULL, NULL };
-
-  return (struct key_value_pair) { env + caret,
-                                   env + caret + strlen(&env[caret]) +1 };
-}
-
 static inline mach_port_t mach_get_bs_port(char* name) {
   mach_port_name_t task = mach_task_self();
 
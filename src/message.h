@@ -0,0 +1,132 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define m_clone(dst, src) { \
+  dst = malloc(strlen(src) + 1); \
+  memcpy(dst, src, strlen(src) + 1); \
+}
+
+#define MESSAGE_INITIAL_SIZE 256
+#define MESSAGE_INITIAL_FRAGMENTS 16
+
+// A message is a single growable arena holding NUL separated fragments
+// (the tokens of a sketchybar command). The offset of every fragment is kept
+// such that individual tokens can be revisited without scanning the buffer.
+struct message {
+  char* buffer;
+  uint32_t length;
+  uint32_t size;
+
+  uint32_t* fragments;
+  uint32_t num_fragments;
+  uint32_t fragments_size;
+};
+
+static inline void message_init(struct message* message) {
+  memset(message, 0, sizeof(struct message));
+}
+
+static inline void message_reserve(struct message* message, uint32_t length) {
+  // One byte is always kept in reserve for the terminating NUL
+  uint32_t required = message->length + length + 1;
+  if (required <= message->size) return;
+
+  uint32_t size = message->size ? message->size : MESSAGE_INITIAL_SIZE;
+  while (size < required) size *= 2;
+
+  message->buffer = realloc(message->buffer, size);
+  message->size = size;
+}
+
+static inline void message_append(struct message* message, const char* value, uint32_t length) {
+  message_reserve(message, length);
+  memcpy(message->buffer + message->length, value, length);
+  message->length += length;
+  message->buffer[message->length] = '\0';
+}
+
+// Reserves room for at most `length` bytes and returns the position to
+// write them to, the number of bytes written is passed to message_advance
+static inline char* message_claim(struct message* message, uint32_t length) {
+  message_reserve(message, length);
+  return message->buffer + message->length;
+}
+
+static inline void message_advance(struct message* message, uint32_t length) {
+  message->length += length;
+  message->buffer[message->length] = '\0';
+}
+
+static inline void message_begin_fragment(struct message* message) {
+  if (message->num_fragments == message->fragments_size) {
+    message->fragments_size = message->fragments_size
+                              ? 2 * message->fragments_size
+                              : MESSAGE_INITIAL_FRAGMENTS;
+
+    message->fragments = realloc(message->fragments,
+                                 sizeof(uint32_t) * message->fragments_size);
+  }
+  message->fragments[message->num_fragments++] = message->length;
+}
+
+static inline void message_end_fragment(struct message* message) {
+  message_reserve(message, 1);
+  message->buffer[message->length++] = '\0';
+  message->buffer[message->length] = '\0';
+}
+
+static inline void message_push_lstring(struct message* message, const char* value, uint32_t length) {
+  message_begin_fragment(message);
+  message_append(message, value, length);
+  message_end_fragment(message);
+}
+
+static inline void message_push(struct message* message, const char* value) {
+  message_push_lstring(message, value, strlen(value));
+}
+
+static inline void message_append_message(struct message* message, struct message* other) {
+  if (other->num_fragments == 0) return;
+
+  uint32_t offset = message->length;
+  message_append(message, other->buffer, other->length);
+  for (uint32_t i = 0; i < other->num_fragments; i++) {
+    message_begin_fragment(message);
+    message->fragments[message->num_fragments - 1] = offset
+                                                     + other->fragments[i];
+  }
+}
+
+static inline char* message_fragment(struct message* message, uint32_t index) {
+  return message->buffer + message->fragments[index];
+}
+
+static inline uint32_t message_fragment_length(struct message* message, uint32_t index) {
+  uint32_t end = index + 1 < message->num_fragments
+                 ? message->fragments[index + 1]
+                 : message->length;
+
+  return end - message->fragments[index] - 1;
+}
+
+// Relative values (e.g. `drawing=toggle`) depend on the current value of the
+// property, such that they can neither be dropped nor replaced by later ones
+static inline bool message_value_is_relative(const char* value, uint32_t length) {
+  return length == 6 && memcmp(value, "toggle", 6) == 0;
+}
+
+static inline void message_reset(struct message* message) {
+  message->length = 0;
+  message->num_fragments = 0;
+  if (message->buffer) *message->buffer = '\0';
+}
+
+static inline void message_clean(struct message* message) {
+  if (message->buffer) free(message->buffer);
+  if (message->fragments) free(message->fragments);
+  message_init(message);
+}
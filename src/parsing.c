@@ -1,171 +1,279 @@
 #include "parsing.h"
 #include <math.h>
 
-void json_object_to_lua_table(lua_State* state, cJSON* json);
-
-void json_array_to_lua_table(lua_State* state, cJSON* json) {
-  int i = 1;
-  cJSON* item;
-  lua_newtable(state);
-  cJSON_ArrayForEach(item, json) {
-    switch (item->type) {
-      case cJSON_Number:
-        if (fabs(item->valuedouble - (double)item->valueint) < 1e-5)
-          lua_pushinteger(state, item->valueint);
-        else
-          lua_pushnumber(state, item->valuedouble);
-        break;
-      case cJSON_String:
-        lua_pushstring(state, item->valuestring);
-        break;
-      case cJSON_Array:
-        json_array_to_lua_table(state, item);
-        break;
-      case cJSON_Object:
-        json_object_to_lua_table(state, item);
-        break;
-      case cJSON_True:
-        lua_pushboolean(state, true);
-        break;
-      case cJSON_False:
-        lua_pushboolean(state, false);
-        break;
-      default:
-        lua_pushnil(state);
-        break;
-    }
-    
-    lua_rawseti(state, -2, i);
-    i++;
+bool g_parse_strict = false;
+
+enum property_type parse_key_type(const char* key, uint32_t length) {
+  return schema_classify(key, length);
+}
+
+// Values which are not properties (e.g. trigger env variables) are not
+// typed by the schema, only numbers keyed `color` or `border_color` are
+// written as hex colors, as they always have been
+enum property_type parse_untyped_key_type(const char* key, uint32_t length) {
+  const char* leaf = key + length;
+  while (leaf > key && *(leaf - 1) != '.') leaf--;
+  uint32_t leaf_len = length - (leaf - key);
+  if ((leaf_len == 5 && memcmp(leaf, "color", 5) == 0)
+      || (leaf_len == 12 && memcmp(leaf, "border_color", 12) == 0)) {
+    return PROPERTY_COLOR;
   }
+  return PROPERTY_UNKNOWN;
 }
 
-void json_object_to_lua_table(lua_State* state, cJSON* json) {
-  lua_newtable(state);
-  cJSON* item;
-  cJSON_ArrayForEach(item, json) {
-    lua_pushstring(state, item->string);
-    switch (item->type) {
-      case cJSON_Number:
-        if (fabs(item->valuedouble - (double)item->valueint) < 1e-5)
-          lua_pushinteger(state, item->valueint);
-        else
-          lua_pushnumber(state, item->valuedouble);
-        break;
-      case cJSON_String:
-        lua_pushstring(state, item->valuestring);
-        break;
-      case cJSON_Array:
-        json_array_to_lua_table(state, item);
-        break;
-      case cJSON_Object:
-        json_object_to_lua_table(state, item);
-        break;
-      case cJSON_True:
-        lua_pushboolean(state, true);
-        break;
-      case cJSON_False:
-        lua_pushboolean(state, false);
-        break;
-      default:
-        lua_pushnil(state);
-        break;
-    }
-    lua_settable(state, -3);
+// Classifies the key path of a property, keys unknown to the schema are
+// typed like values which are not properties. Returns false if the key is
+// unknown and has to be dropped.
+bool parse_property_key(const char* key, uint32_t length, enum property_type* type) {
+  *type = parse_key_type(key, length);
+  if (*type != PROPERTY_UNKNOWN) return true;
+  if (g_parse_strict) return false;
+
+  *type = parse_untyped_key_type(key, length);
+  return true;
+}
+
+#define PARSE_NUMBER_MAX 64
+
+static const double g_powers_of_ten[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5,
+                                          1e6, 1e7, 1e8                  };
+
+static uint32_t parse_format_unsigned(char* out, uint64_t value) {
+  char digits[20];
+  uint32_t count = 0;
+  do {
+    digits[count++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+
+  for (uint32_t i = 0; i < count; i++) out[i] = digits[count - 1 - i];
+  return count;
+}
+
+static uint32_t parse_format_integer(char* out, lua_Integer value) {
+  if (value < 0) {
+    *out = '-';
+    return 1 + parse_format_unsigned(out + 1, 0 - (uint64_t)value);
   }
+  return parse_format_unsigned(out, value);
+}
+
+static uint32_t parse_format_hex(char* out, uint32_t value) {
+  static const char hex[] = "0123456789abcdef";
+  uint32_t len = 2;
+  out[0] = '0';
+  out[1] = 'x';
+
+  int shift = 28;
+  while (shift > 0 && !(value >> shift)) shift -= 4;
+  for (; shift >= 0; shift -= 4) out[len++] = hex[(value >> shift) & 0xf];
+  return len;
 }
 
-bool json_to_lua_table(lua_State* state, const char* json_str) {
-  cJSON* json = cJSON_Parse(json_str);
-  if (!json) {
-    return false;
+// Formats floats exactly like lua_tostring ("%.14g" and a trailing ".0" for
+// integral values). Values with at most twelve significant digits and eight
+// decimals are formatted directly, everything else falls back to snprintf.
+static uint32_t parse_format_float(char* out, lua_Number value) {
+  lua_Number magnitude = value < 0 ? -value : value;
+  uint32_t len = 0;
+
+  if (magnitude == 0 || (magnitude >= 1e-4 && magnitude < 1e12)) {
+    for (int decimals = 0; decimals <= 8; decimals++) {
+      lua_Number scaled = magnitude * g_powers_of_ten[decimals];
+      if (scaled >= 1e12) break;
+
+      uint64_t digits = (uint64_t)scaled;
+      if ((lua_Number)digits != scaled) continue;
+
+      if (signbit(value)) out[len++] = '-';
+      uint64_t divisor = (uint64_t)g_powers_of_ten[decimals];
+      len += parse_format_unsigned(out + len, digits / divisor);
+      out[len++] = '.';
+      uint64_t fraction = digits % divisor;
+      for (int i = decimals - 1; i >= 0; i--) {
+        out[len + i] = '0' + fraction % 10;
+        fraction /= 10;
+      }
+      len += decimals;
+
+      // Rounding in the scaling may leave trailing zeros
+      while (len > 0 && out[len - 1] == '0' && out[len - 2] != '.') len--;
+      if (decimals == 0) out[len++] = '0';
+      return len;
+    }
   }
 
-  if (cJSON_IsInvalid(json)) {
-    cJSON_Delete(json);
-    return false;
+  len = snprintf(out, PARSE_NUMBER_MAX, LUA_NUMBER_FMT, (LUAI_UACNUMBER)value);
+  if (out[strspn(out, "-0123456789")] == '\0') {
+    // Looks like an integer, mark it as a float
+    out[len++] = '.';
+    out[len++] = '0';
   }
+  return len;
+}
+
+void parse_value(lua_State* state, int index, enum property_type type, struct message* message) {
+  const char* value;
+  size_t value_len;
 
-  switch (json->type) {
-    case cJSON_Array:
-      json_array_to_lua_table(state, json);
-      break;
-    case cJSON_Object:
-      json_object_to_lua_table(state, json);
-      break;
-    default:
-      cJSON_Delete(json);
-      return false;
-      break;
+  if (lua_type(state, index) == LUA_TBOOLEAN) {
+    if (lua_toboolean(state, index)) value = "on", value_len = 2;
+    else value = "off", value_len = 3;
+  } else if (lua_type(state, index) == LUA_TNUMBER) {
+    // Numbers are written straight into the message buffer
+    char* out = message_claim(message, PARSE_NUMBER_MAX);
+    lua_Number number = lua_tonumber(state, index);
+    if (type == PROPERTY_COLOR) {
+      uint32_t hex = number;
+      message_advance(message, parse_format_hex(out, hex));
+    } else if (type == PROPERTY_INTEGER
+               && !lua_isinteger(state, index)
+               && number == floor(number)
+               && fabs(number) < 1e15) {
+      message_advance(message,
+                      parse_format_integer(out, (lua_Integer)number));
+    } else if (lua_isinteger(state, index)) {
+      message_advance(message,
+                      parse_format_integer(out, lua_tointeger(state, index)));
+    } else {
+      message_advance(message,
+                      parse_format_float(out, lua_tonumber(state, index)));
+    }
+    return;
+  } else {
+    value = lua_tolstring(state, index, &value_len);
   }
-  cJSON_Delete(json);
-  return true;
+  message_append(message, value, value_len);
 }
 
-void parse_kv_table(lua_State* state, char* prefix, struct stack* stack) {
+struct parse_frame {
+  uint32_t prefix_len;
+  lua_Integer index;
+  lua_Integer length;
+};
+
+static char* g_path = NULL;
+static uint32_t g_path_size = 0;
+
+static inline void parse_path_reserve(uint32_t length) {
+  if (length + 1 <= g_path_size) return;
+  while (g_path_size < length + 1)
+    g_path_size = g_path_size ? 2 * g_path_size : 256;
+  g_path = realloc(g_path, g_path_size);
+}
+
+// Walks the (nested) table on top of the stack and appends a `key.path=value`
+// fragment for every leaf. If `properties` is set, the keys are sketchybar
+// properties typed by the schema (see parse_property_key), otherwise the
+// schema is not used to format the values. Instead of recursing, the tables currently being
+// traversed are kept on the Lua stack together with their iteration key,
+// and the key path is built in a single buffer that is truncated again when
+// a table is left. Array-like tables are visited in index order.
+void parse_kv_table(lua_State* state, struct message* message, bool properties) {
+  struct parse_frame frames[PARSE_MAX_DEPTH];
+  char key_buffer[PARSE_NUMBER_MAX];
+  uint32_t path_len = 0;
+  int depth = 0;
+
+  if (!lua_checkstack(state, 2 * PARSE_MAX_DEPTH + 2)) return;
+  parse_path_reserve(0);
+  *g_path = '\0';
+
+  lua_pushvalue(state, -1);
   lua_pushnil(state);
-  const char* key,* value;
-  char hex[16];
+  frames[0] = (struct parse_frame) { 0, 0, lua_rawlen(state, -2) };
 
-  while (lua_next(state, -2)) {
-    if (lua_isnil(state, -2)) {
-      return;
-    }
+  for (;;) {
+    struct parse_frame* frame = &frames[depth];
+    const char* key;
+    size_t key_len;
 
-    key = lua_tostring(state, -2);
+    if (frame->index < frame->length) {
+      if (lua_rawgeti(state, -2, ++frame->index) == LUA_TNIL) {
+        lua_pop(state, 1);
+        continue;
+      }
+      key_len = parse_format_integer(key_buffer, frame->index);
+      key = key_buffer;
+    } else {
+      if (!lua_next(state, -2)) {
+        lua_pop(state, 1);
+        if (depth == 0) break;
+        path_len = frames[--depth].prefix_len;
+        continue;
+      }
 
-    if (lua_type(state, -1) == LUA_TTABLE) {
-      if (prefix) {
-        uint32_t new_prefix_len = (prefix ? strlen(prefix) : 0)
-                                  + strlen(key)
-                                  + 2;
-
-        char new_prefix[new_prefix_len];
-        snprintf(new_prefix, new_prefix_len, "%s.%s", prefix, key);
-        parse_kv_table(state, new_prefix, stack);
+      if (lua_type(state, -2) == LUA_TSTRING) {
+        key = lua_tolstring(state, -2, &key_len);
+      } else if (lua_isinteger(state, -2)) {
+        lua_Integer index = lua_tointeger(state, -2);
+        if (index >= 1 && index <= frame->length) {
+          // Already visited in the array part
+          lua_pop(state, 1);
+          continue;
+        }
+        key_len = parse_format_integer(key_buffer, index);
+        key = key_buffer;
+      } else if (lua_type(state, -2) == LUA_TNUMBER) {
+        key_len = parse_format_float(key_buffer, lua_tonumber(state, -2));
+        key = key_buffer;
       } else {
-        parse_kv_table(state, (char*)key, stack);
+        lua_pop(state, 1);
+        continue;
       }
     }
-    else {
-      if (lua_type(state, -1) == LUA_TBOOLEAN) {
-        value = lua_toboolean(state, -1) ? "on" : "off";
-      } else {
-        if ((strcmp(key, "color") == 0 || strcmp(key, "border_color") == 0)
-            && lua_type(state, -1) == LUA_TNUMBER) {
-          uint32_t number = lua_tonumber(state, -1);
-          snprintf(hex, 16, "0x%x", number);
-          value = hex;
-        } else {
-          value = lua_tostring(state, -1);
-        }
-      }
 
-      uint32_t kv_pair_len = (prefix ? strlen(prefix) + 1 : 0)
-                              + strlen(value)
-                              + strlen(key)
-                              + 5;
+    parse_path_reserve(path_len + key_len + 1);
+    if (path_len > 0) g_path[path_len++] = '.';
+    memcpy(g_path + path_len, key, key_len);
+    path_len += key_len;
+    g_path[path_len] = '\0';
 
-      char kv_pair[kv_pair_len];
-      if (prefix) {
-        snprintf(kv_pair, kv_pair_len, "%s.%s=%s", prefix, key, value);
-      }
-      else {
-        snprintf(kv_pair, kv_pair_len, "%s=%s", key, value);
+    if (lua_type(state, -1) == LUA_TTABLE) {
+      if (depth + 1 >= PARSE_MAX_DEPTH) {
+        printf("[Lua] Error: property table nested too deeply at '%s'\n",
+               g_path                                                    );
+        lua_pop(state, 1);
+        path_len = frame->prefix_len;
+        continue;
       }
-      stack_push(stack, kv_pair);
+
+      frames[++depth] = (struct parse_frame) { path_len,
+                                               0,
+                                               lua_rawlen(state, -1) };
+      lua_pushnil(state);
+      continue;
+    }
+
+    enum property_type type = PROPERTY_UNKNOWN;
+    bool known = true;
+    if (!properties) {
+      type = parse_untyped_key_type(g_path, path_len);
+    } else if (!(known = parse_property_key(g_path, path_len, &type))) {
+      printf("[Lua] Error: unknown property '%s'\n", g_path);
     }
+
+    if (known) {
+      message_begin_fragment(message);
+      message_append(message, g_path, path_len);
+      message_append(message, "=", 1);
+      parse_value(state, -1, type, message);
+      message_end_fragment(message);
+    }
+
     lua_pop(state, 1);
+    path_len = frame->prefix_len;
   }
 }
 
-void parse_table_values_to_stack(lua_State* state, int index, struct stack* stack) {
+void parse_table_values_to_message(lua_State* state, int index, struct message* message) {
   lua_pushvalue(state, index);
   lua_pushnil(state);
   while (lua_next(state, -2)) {
     lua_pushvalue(state, -2);
-    const char* value = lua_tostring(state, -2);
-    stack_push(stack, value);
+    size_t value_len;
+    const char* value = lua_tolstring(state, -2, &value_len);
+    message_push_lstring(message, value, value_len);
     lua_pop(state, 2);
   }
 }
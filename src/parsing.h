@@ -6,10 +6,23 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
-#include "cJSON.h"
-#include "stack.h"
+#include "message.h"
+#include "schema.h"
 
-void parse_kv_table(lua_State* state, char* prefix, struct stack* stack);
-void parse_table_values_to_stack(lua_State* state, int index, struct stack* stack);
-bool json_to_lua_table(lua_State* state, const char* json_str);
+// The maximum nesting depth of property tables
+#ifndef PARSE_MAX_DEPTH
+#define PARSE_MAX_DEPTH 16
+#endif
+
+// If set, property keys unknown to the schema are reported and dropped,
+// otherwise they are sent along, as sketchybar may know properties which the
+// schema does not
+extern bool g_parse_strict;
+
+enum property_type parse_key_type(const char* key, uint32_t length);
+enum property_type parse_untyped_key_type(const char* key, uint32_t length);
+bool parse_property_key(const char* key, uint32_t length, enum property_type* type);
+void parse_value(lua_State* state, int index, enum property_type type, struct message* message);
+void parse_kv_table(lua_State* state, struct message* message, bool properties);
+void parse_table_values_to_message(lua_State* state, int index, struct message* message);
 
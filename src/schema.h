@@ -0,0 +1,346 @@
+#pragma once
+// Generated by tools/schema.py, do not edit.
+#include "hash.h"
+#include <stdint.h>
+#include <string.h>
+
+enum property_type {
+  PROPERTY_UNKNOWN,
+  PROPERTY_COLOR,
+  PROPERTY_BOOLEAN,
+  PROPERTY_INTEGER,
+  PROPERTY_FLOAT,
+  PROPERTY_STRING,
+};
+
+struct property {
+  const char* name;
+  uint32_t length;
+  enum property_type type;
+};
+
+#define SCHEMA_SIZE 271
+
+static const uint32_t g_schema_seeds[SCHEMA_SIZE] = {
+  1, 2, 0, 1, 1, 6, 1, 2,
+  0, 0, 0, 0, 1, 0, 7, 3,
+  5, 0, 1, 4, 3, 8, 1, 0,
+  0, 0, 2, 0, 1, 0, 0, 0,
+  0, 0, 3, 0, 0, 1, 3, 1,
+  1, 2, 1, 2, 1, 4, 2, 3,
+  1, 2, 2, 0, 2, 0, 1, 2,
+  4, 0, 0, 7, 0, 0, 1, 0,
+  0, 4, 0, 1, 0, 2, 0, 4,
+  6, 2, 11, 0, 0, 8, 2, 0,
+  5, 9, 9, 6, 1, 2, 0, 0,
+  5, 0, 1, 1, 2, 0, 7, 0,
+  4, 5, 4, 1, 6, 3, 1, 1,
+  1, 0, 0, 3, 0, 0, 1, 1,
+  0, 0, 0, 0, 2, 4, 1, 5,
+  3, 2, 9, 1, 0, 1, 4, 4,
+  3, 10, 2, 7, 0, 5, 2, 2,
+  3, 0, 1, 3, 0, 0, 0, 2,
+  4, 0, 2, 1, 0, 2, 1, 0,
+  0, 0, 3, 1, 0, 0, 1, 0,
+  5, 0, 4, 3, 4, 0, 3, 0,
+  5, 10, 0, 0, 0, 6, 0, 2,
+  0, 3, 6, 0, 0, 0, 4, 0,
+  4, 0, 4, 0, 0, 13, 1, 0,
+  0, 13, 3, 15, 0, 5, 0, 14,
+  3, 12, 1, 0, 3, 18, 0, 4,
+  9, 0, 0, 0, 4, 20, 8, 0,
+  12, 3, 4, 0, 6, 5, 8, 0,
+  6, 33, 0, 2, 0, 2, 0, 2,
+  10, 5, 0, 0, 8, 6, 3, 17,
+  0, 0, 27, 0, 0, 5, 6, 0,
+  6, 3, 48, 0, 39, 3, 49, 67,
+  1, 10, 0, 96, 3, 0, 23, 70,
+  1, 37, 1, 0, 176, 3, 285,
+};
+
+static const struct property g_schema[SCHEMA_SIZE] = {
+  { "label.background.border_width", 29, PROPERTY_INTEGER },
+  { "corner_radius", 13, PROPERTY_INTEGER },
+  { "background.shadow.angle", 23, PROPERTY_INTEGER },
+  { "slider.knob.string", 18, PROPERTY_STRING },
+  { "slider.knob.shadow.color", 24, PROPERTY_COLOR },
+  { "background.image.y_offset", 25, PROPERTY_INTEGER },
+  { "icon.background.border_width", 28, PROPERTY_INTEGER },
+  { "image.padding_left", 18, PROPERTY_INTEGER },
+  { "slider.highlight_color", 22, PROPERTY_COLOR },
+  { "slider.percentage", 17, PROPERTY_INTEGER },
+  { "popup.height", 12, PROPERTY_INTEGER },
+  { "label.background.image.drawing", 30, PROPERTY_BOOLEAN },
+  { "padding_right", 13, PROPERTY_INTEGER },
+  { "icon.drawing", 12, PROPERTY_BOOLEAN },
+  { "icon.background.x_offset", 24, PROPERTY_INTEGER },
+  { "icon.highlight", 14, PROPERTY_BOOLEAN },
+  { "script", 6, PROPERTY_STRING },
+  { "slider.background.shadow.distance", 33, PROPERTY_INTEGER },
+  { "icon.background.image.y_offset", 30, PROPERTY_INTEGER },
+  { "slider.knob.highlight", 21, PROPERTY_BOOLEAN },
+  { "slider.background.padding_left", 30, PROPERTY_INTEGER },
+  { "popup.background.shadow.angle", 29, PROPERTY_INTEGER },
+  { "icon.string", 11, PROPERTY_STRING },
+  { "slider.background.shadow.color", 30, PROPERTY_COLOR },
+  { "slider.background.border_color", 30, PROPERTY_COLOR },
+  { "label.shadow.drawing", 20, PROPERTY_BOOLEAN },
+  { "popup.background.shadow.distance", 32, PROPERTY_INTEGER },
+  { "slider.knob.background.x_offset", 31, PROPERTY_INTEGER },
+  { "slider.knob.y_offset", 20, PROPERTY_INTEGER },
+  { "icon", 4, PROPERTY_STRING },
+  { "slider.background.border_width", 30, PROPERTY_INTEGER },
+  { "background.drawing", 18, PROPERTY_BOOLEAN },
+  { "graph.fill_color", 16, PROPERTY_COLOR },
+  { "image.drawing", 13, PROPERTY_BOOLEAN },
+  { "image.corner_radius", 19, PROPERTY_INTEGER },
+  { "slider.knob.background.image.y_offset", 37, PROPERTY_INTEGER },
+  { "image.border_width", 18, PROPERTY_INTEGER },
+  { "popup.background.border_width", 29, PROPERTY_INTEGER },
+  { "label.y_offset", 14, PROPERTY_INTEGER },
+  { "slider.knob.shadow.distance", 27, PROPERTY_INTEGER },
+  { "popup.background.image.y_offset", 31, PROPERTY_INTEGER },
+  { "slider.background.image.drawing", 31, PROPERTY_BOOLEAN },
+  { "slider.knob.background.y_offset", 31, PROPERTY_INTEGER },
+  { "scroll_texts", 12, PROPERTY_BOOLEAN },
+  { "popup.background.image.scale", 28, PROPERTY_FLOAT },
+  { "slider.knob.background.color", 28, PROPERTY_COLOR },
+  { "slider.background.image.string", 30, PROPERTY_STRING },
+  { "label.padding_right", 19, PROPERTY_INTEGER },
+  { "popup.background.image.border_color", 35, PROPERTY_COLOR },
+  { "slider.background.image.border_color", 36, PROPERTY_COLOR },
+  { "icon.background.shadow.drawing", 30, PROPERTY_BOOLEAN },
+  { "background.x_offset", 19, PROPERTY_INTEGER },
+  { "image.padding_right", 19, PROPERTY_INTEGER },
+  { "slider.background.image", 23, PROPERTY_STRING },
+  { "slider.knob", 11, PROPERTY_STRING },
+  { "icon.padding_right", 18, PROPERTY_INTEGER },
+  { "space", 5, PROPERTY_INTEGER },
+  { "background.image.scale", 22, PROPERTY_FLOAT },
+  { "slider.knob.font", 16, PROPERTY_STRING },
+  { "slider.background.image.border_width", 36, PROPERTY_INTEGER },
+  { "label.color", 11, PROPERTY_COLOR },
+  { "popup.background.padding_left", 29, PROPERTY_INTEGER },
+  { "label.shadow.angle", 18, PROPERTY_INTEGER },
+  { "popup.background.padding_right", 30, PROPERTY_INTEGER },
+  { "label.background.image.string", 29, PROPERTY_STRING },
+  { "background.border_color", 23, PROPERTY_COLOR },
+  { "label.background.corner_radius", 30, PROPERTY_INTEGER },
+  { "notch_offset", 12, PROPERTY_INTEGER },
+  { "slider.background.corner_radius", 31, PROPERTY_INTEGER },
+  { "icon.background.image", 21, PROPERTY_STRING },
+  { "background.padding_right", 24, PROPERTY_INTEGER },
+  { "notch_display_height", 20, PROPERTY_INTEGER },
+  { "icon.background.clip", 20, PROPERTY_FLOAT },
+  { "slider.knob.background.image.string", 35, PROPERTY_STRING },
+  { "background.shadow.color", 23, PROPERTY_COLOR },
+  { "icon.width", 10, PROPERTY_INTEGER },
+  { "icon.background.drawing", 23, PROPERTY_BOOLEAN },
+  { "label.shadow.distance", 21, PROPERTY_INTEGER },
+  { "slider.knob.width", 17, PROPERTY_INTEGER },
+  { "slider.background.image.scale", 29, PROPERTY_FLOAT },
+  { "popup.background.drawing", 24, PROPERTY_BOOLEAN },
+  { "image.y_offset", 14, PROPERTY_INTEGER },
+  { "label.highlight", 15, PROPERTY_BOOLEAN },
+  { "icon.background.image.padding_right", 35, PROPERTY_INTEGER },
+  { "image.scale", 11, PROPERTY_FLOAT },
+  { "font_smoothing", 14, PROPERTY_BOOLEAN },
+  { "popup.align", 11, PROPERTY_STRING },
+  { "slider.knob.background.shadow.color", 35, PROPERTY_COLOR },
+  { "background.clip", 15, PROPERTY_FLOAT },
+  { "label.background.image.padding_left", 35, PROPERTY_INTEGER },
+  { "notch_width", 11, PROPERTY_INTEGER },
+  { "icon.background.image.border_width", 34, PROPERTY_INTEGER },
+  { "slider.background.shadow.drawing", 32, PROPERTY_BOOLEAN },
+  { "popup.horizontal", 16, PROPERTY_BOOLEAN },
+  { "slider.knob.background.height", 29, PROPERTY_INTEGER },
+  { "slider.knob.background.border_color", 35, PROPERTY_COLOR },
+  { "label.background.y_offset", 25, PROPERTY_INTEGER },
+  { "icon.y_offset", 13, PROPERTY_INTEGER },
+  { "background.image.padding_right", 30, PROPERTY_INTEGER },
+  { "popup.background.corner_radius", 30, PROPERTY_INTEGER },
+  { "alias.update_freq", 17, PROPERTY_INTEGER },
+  { "icon.background.image.border_color", 34, PROPERTY_COLOR },
+  { "popup.background.height", 23, PROPERTY_INTEGER },
+  { "slider.background.image.y_offset", 32, PROPERTY_INTEGER },
+  { "background.image.string", 23, PROPERTY_STRING },
+  { "label.align", 11, PROPERTY_STRING },
+  { "slider.width", 12, PROPERTY_INTEGER },
+  { "icon.color", 10, PROPERTY_COLOR },
+  { "popup.background.image", 22, PROPERTY_STRING },
+  { "label.font.size", 15, PROPERTY_FLOAT },
+  { "slider.knob.font.size", 21, PROPERTY_FLOAT },
+  { "background.image.padding_left", 29, PROPERTY_INTEGER },
+  { "background.y_offset", 19, PROPERTY_INTEGER },
+  { "blur_radius", 11, PROPERTY_INTEGER },
+  { "label.background.image.border_color", 35, PROPERTY_COLOR },
+  { "icon.background.padding_right", 29, PROPERTY_INTEGER },
+  { "popup.background.y_offset", 25, PROPERTY_INTEGER },
+  { "background.color", 16, PROPERTY_COLOR },
+  { "label.font.style", 16, PROPERTY_STRING },
+  { "icon.shadow.angle", 17, PROPERTY_INTEGER },
+  { "popup.topmost", 13, PROPERTY_BOOLEAN },
+  { "popup.blur_radius", 17, PROPERTY_INTEGER },
+  { "background.height", 17, PROPERTY_INTEGER },
+  { "slider.knob.font.style", 22, PROPERTY_STRING },
+  { "slider.knob.background.image.corner_radius", 42, PROPERTY_INTEGER },
+  { "label.background.image.padding_right", 36, PROPERTY_INTEGER },
+  { "slider.knob.background.drawing", 30, PROPERTY_BOOLEAN },
+  { "label.background.height", 23, PROPERTY_INTEGER },
+  { "slider.knob.background.padding_left", 35, PROPERTY_INTEGER },
+  { "icon.scroll_duration", 20, PROPERTY_INTEGER },
+  { "slider.knob.background.image.drawing", 36, PROPERTY_BOOLEAN },
+  { "graph.line_width", 16, PROPERTY_FLOAT },
+  { "alias.scale", 11, PROPERTY_FLOAT },
+  { "popup.background.clip", 21, PROPERTY_FLOAT },
+  { "background.image.border_color", 29, PROPERTY_COLOR },
+  { "icon.background.corner_radius", 29, PROPERTY_INTEGER },
+  { "icon.background.shadow.color", 28, PROPERTY_COLOR },
+  { "popup.background.image.corner_radius", 36, PROPERTY_INTEGER },
+  { "icon.highlight_color", 20, PROPERTY_COLOR },
+  { "slider.background.clip", 22, PROPERTY_FLOAT },
+  { "icon.background.image.padding_left", 34, PROPERTY_INTEGER },
+  { "slider.knob.color", 17, PROPERTY_COLOR },
+  { "slider.knob.highlight_color", 27, PROPERTY_COLOR },
+  { "slider.background.y_offset", 26, PROPERTY_INTEGER },
+  { "display", 7, PROPERTY_INTEGER },
+  { "icon.max_chars", 14, PROPERTY_INTEGER },
+  { "associated_display", 18, PROPERTY_INTEGER },
+  { "slider.knob.align", 17, PROPERTY_STRING },
+  { "popup.background.color", 22, PROPERTY_COLOR },
+  { "slider.knob.shadow.drawing", 26, PROPERTY_BOOLEAN },
+  { "label.width", 11, PROPERTY_INTEGER },
+  { "label.background.border_color", 29, PROPERTY_COLOR },
+  { "label.highlight_color", 21, PROPERTY_COLOR },
+  { "icon.font.style", 15, PROPERTY_STRING },
+  { "slider.knob.background.border_width", 35, PROPERTY_INTEGER },
+  { "image", 5, PROPERTY_STRING },
+  { "icon.shadow.distance", 20, PROPERTY_INTEGER },
+  { "popup.background.x_offset", 25, PROPERTY_INTEGER },
+  { "slider.knob.max_chars", 21, PROPERTY_INTEGER },
+  { "label.background.padding_left", 29, PROPERTY_INTEGER },
+  { "click_script", 12, PROPERTY_STRING },
+  { "label.background.shadow.color", 29, PROPERTY_COLOR },
+  { "width", 5, PROPERTY_INTEGER },
+  { "popup.background.image.padding_left", 35, PROPERTY_INTEGER },
+  { "topmost", 7, PROPERTY_BOOLEAN },
+  { "background.image.corner_radius", 30, PROPERTY_INTEGER },
+  { "icon.font", 9, PROPERTY_STRING },
+  { "slider.background.image.padding_right", 37, PROPERTY_INTEGER },
+  { "alias.color", 11, PROPERTY_COLOR },
+  { "slider.knob.scroll_duration", 27, PROPERTY_INTEGER },
+  { "label.drawing", 13, PROPERTY_BOOLEAN },
+  { "margin", 6, PROPERTY_INTEGER },
+  { "icon.background.image.corner_radius", 35, PROPERTY_INTEGER },
+  { "padding_left", 12, PROPERTY_INTEGER },
+  { "label.background.image", 22, PROPERTY_STRING },
+  { "icon.background.border_color", 28, PROPERTY_COLOR },
+  { "background.image.drawing", 24, PROPERTY_BOOLEAN },
+  { "icon.background.padding_left", 28, PROPERTY_INTEGER },
+  { "color", 5, PROPERTY_COLOR },
+  { "label.scroll_duration", 21, PROPERTY_INTEGER },
+  { "graph.color", 11, PROPERTY_COLOR },
+  { "label.string", 12, PROPERTY_STRING },
+  { "popup.background.border_color", 29, PROPERTY_COLOR },
+  { "slider.background.shadow.angle", 30, PROPERTY_INTEGER },
+  { "slider.knob.background.image.padding_right", 42, PROPERTY_INTEGER },
+  { "slider.knob.background.corner_radius", 36, PROPERTY_INTEGER },
+  { "popup.y_offset", 14, PROPERTY_INTEGER },
+  { "background.image", 16, PROPERTY_STRING },
+  { "icon.background.shadow.angle", 28, PROPERTY_INTEGER },
+  { "slider.knob.background.image.border_color", 41, PROPERTY_COLOR },
+  { "slider.knob.padding_left", 24, PROPERTY_INTEGER },
+  { "slider.background.height", 24, PROPERTY_INTEGER },
+  { "slider.background.image.padding_left", 36, PROPERTY_INTEGER },
+  { "label.font.family", 17, PROPERTY_STRING },
+  { "updates", 7, PROPERTY_BOOLEAN },
+  { "slider.knob.shadow.angle", 24, PROPERTY_INTEGER },
+  { "popup.background.shadow.color", 29, PROPERTY_COLOR },
+  { "associated_space", 16, PROPERTY_INTEGER },
+  { "icon.background.height", 22, PROPERTY_INTEGER },
+  { "ignore_association", 18, PROPERTY_BOOLEAN },
+  { "slider.knob.font.family", 23, PROPERTY_STRING },
+  { "slider.knob.background.image.border_width", 41, PROPERTY_INTEGER },
+  { "slider.knob.drawing", 19, PROPERTY_BOOLEAN },
+  { "slider.background.x_offset", 26, PROPERTY_INTEGER },
+  { "label.background.clip", 21, PROPERTY_FLOAT },
+  { "slider.background.color", 23, PROPERTY_COLOR },
+  { "label.font", 10, PROPERTY_STRING },
+  { "slider.knob.background.clip", 27, PROPERTY_FLOAT },
+  { "label.background.drawing", 24, PROPERTY_BOOLEAN },
+  { "slider.knob.padding_right", 25, PROPERTY_INTEGER },
+  { "icon.padding_left", 17, PROPERTY_INTEGER },
+  { "popup.background.image.drawing", 30, PROPERTY_BOOLEAN },
+  { "icon.background.shadow.distance", 31, PROPERTY_INTEGER },
+  { "icon.background.image.drawing", 29, PROPERTY_BOOLEAN },
+  { "image.string", 12, PROPERTY_STRING },
+  { "border_color", 12, PROPERTY_COLOR },
+  { "label", 5, PROPERTY_STRING },
+  { "slider.knob.background.image.padding_left", 41, PROPERTY_INTEGER },
+  { "icon.background.color", 21, PROPERTY_COLOR },
+  { "background.image.border_width", 29, PROPERTY_INTEGER },
+  { "label.background.shadow.distance", 32, PROPERTY_INTEGER },
+  { "slider.background.drawing", 25, PROPERTY_BOOLEAN },
+  { "background.shadow.drawing", 25, PROPERTY_BOOLEAN },
+  { "label.padding_left", 18, PROPERTY_INTEGER },
+  { "slider.knob.background.shadow.angle", 35, PROPERTY_INTEGER },
+  { "hidden", 6, PROPERTY_BOOLEAN },
+  { "label.background.padding_right", 30, PROPERTY_INTEGER },
+  { "icon.shadow.color", 17, PROPERTY_COLOR },
+  { "y_offset", 8, PROPERTY_INTEGER },
+  { "icon.background.y_offset", 24, PROPERTY_INTEGER },
+  { "border_width", 12, PROPERTY_INTEGER },
+  { "update_freq", 11, PROPERTY_INTEGER },
+  { "mach_helper", 11, PROPERTY_STRING },
+  { "popup.background.image.padding_right", 36, PROPERTY_INTEGER },
+  { "slider.background.image.corner_radius", 37, PROPERTY_INTEGER },
+  { "slider.knob.background.shadow.distance", 38, PROPERTY_INTEGER },
+  { "label.background.x_offset", 25, PROPERTY_INTEGER },
+  { "popup.background.image.string", 29, PROPERTY_STRING },
+  { "slider.knob.background.image.scale", 34, PROPERTY_FLOAT },
+  { "drawing", 7, PROPERTY_BOOLEAN },
+  { "label.background.shadow.angle", 29, PROPERTY_INTEGER },
+  { "label.background.color", 22, PROPERTY_COLOR },
+  { "slider.background.padding_right", 31, PROPERTY_INTEGER },
+  { "background.corner_radius", 24, PROPERTY_INTEGER },
+  { "label.background.image.border_width", 35, PROPERTY_INTEGER },
+  { "slider.knob.background.shadow.drawing", 37, PROPERTY_BOOLEAN },
+  { "icon.shadow.drawing", 19, PROPERTY_BOOLEAN },
+  { "shadow", 6, PROPERTY_BOOLEAN },
+  { "height", 6, PROPERTY_INTEGER },
+  { "slider.knob.background.padding_right", 36, PROPERTY_INTEGER },
+  { "label.background.image.corner_radius", 36, PROPERTY_INTEGER },
+  { "label.background.image.y_offset", 31, PROPERTY_INTEGER },
+  { "popup.drawing", 13, PROPERTY_BOOLEAN },
+  { "background.padding_left", 23, PROPERTY_INTEGER },
+  { "icon.align", 10, PROPERTY_STRING },
+  { "image.border_color", 18, PROPERTY_COLOR },
+  { "icon.font.family", 16, PROPERTY_STRING },
+  { "background.shadow.distance", 26, PROPERTY_INTEGER },
+  { "icon.background.image.scale", 27, PROPERTY_FLOAT },
+  { "label.background.shadow.drawing", 31, PROPERTY_BOOLEAN },
+  { "label.background.image.scale", 28, PROPERTY_FLOAT },
+  { "popup.background.image.border_width", 35, PROPERTY_INTEGER },
+  { "slider.knob.background.image", 28, PROPERTY_STRING },
+  { "icon.background.image.string", 28, PROPERTY_STRING },
+  { "sticky", 6, PROPERTY_BOOLEAN },
+  { "position", 8, PROPERTY_STRING },
+  { "popup.background.shadow.drawing", 31, PROPERTY_BOOLEAN },
+  { "background.border_width", 23, PROPERTY_INTEGER },
+  { "label.max_chars", 15, PROPERTY_INTEGER },
+  { "icon.font.size", 14, PROPERTY_FLOAT },
+  { "label.shadow.color", 18, PROPERTY_COLOR },
+};
+
+// Classifies a dot separated property key path
+static inline enum property_type schema_classify(const char* key, uint32_t length) {
+  uint32_t seed = g_schema_seeds[hash_fnv(HASH_SEED, key, length) % SCHEMA_SIZE];
+  const struct property* property
+                  = &g_schema[hash_fnv(seed, key, length) % SCHEMA_SIZE];
+
+  if (property->length != length
+      || memcmp(property->name, key, length) != 0) {
+    return PROPERTY_UNKNOWN;
+  }
+  return property->type;
+}
@@ -0,0 +1,166 @@
+#pragma once
+#include "hash.h"
+#include "message.h"
+#include <stdbool.h>
+
+// The shadow keeps the last value sent for every property key of every item,
+// such that `--set` commands can be stripped of assignments that would not
+// change anything in sketchybar.
+
+struct shadow_property {
+  char* key;
+  uint32_t key_len;
+  char* value;
+  uint32_t value_len;
+};
+
+struct shadow_item {
+  struct hash_entry entry;
+  struct shadow_property* properties;
+  uint32_t num_properties;
+  uint32_t properties_size;
+};
+
+struct shadow {
+  bool enabled;
+  struct hash_table items;
+};
+
+static inline void shadow_property_destroy(struct shadow_property* property) {
+  free(property->key);
+  free(property->value);
+}
+
+static inline void shadow_item_clear(struct shadow_item* item) {
+  for (uint32_t i = 0; i < item->num_properties; i++)
+    shadow_property_destroy(&item->properties[i]);
+  item->num_properties = 0;
+}
+
+static inline struct shadow_item* shadow_get_item(struct shadow* shadow, const char* name, bool create) {
+  return (struct shadow_item*)hash_table_get(&shadow->items,
+                                             name,
+                                             sizeof(struct shadow_item),
+                                             create                     );
+}
+
+static inline void shadow_invalidate_all(struct shadow* shadow) {
+  for (uint32_t i = 0; i < shadow->items.entries_size; i++) {
+    struct shadow_item* item = (struct shadow_item*)shadow->items.entries[i];
+    if (item) shadow_item_clear(item);
+  }
+}
+
+static inline void shadow_invalidate(struct shadow* shadow, const char* name) {
+  if (!name) return;
+  if (*name == '/') {
+    // Regex targets may touch any item
+    shadow_invalidate_all(shadow);
+    return;
+  }
+
+  struct shadow_item* item = shadow_get_item(shadow, name, false);
+  if (item) shadow_item_clear(item);
+}
+
+// Checks if `a` is a dot separated parent path of `b`, e.g. `label` of
+// `label.string`, as both of those address the same property.
+static inline bool shadow_key_is_parent(const char* a, uint32_t a_len, const char* b, uint32_t b_len) {
+  return a_len < b_len && b[a_len] == '.' && memcmp(a, b, a_len) == 0;
+}
+
+// Records the assignment and returns false if it does not change the
+// recorded value. Entries aliasing the key are dropped.
+static inline bool shadow_item_update(struct shadow_item* item, const char* key, uint32_t key_len, const char* value, uint32_t value_len) {
+  // Relative values can not be tracked
+  bool track = !message_value_is_relative(value, value_len);
+
+  for (uint32_t i = 0; i < item->num_properties; i++) {
+    struct shadow_property* property = &item->properties[i];
+    if (property->key_len == key_len
+        && memcmp(property->key, key, key_len) == 0) {
+      if (track && property->value_len == value_len
+          && memcmp(property->value, value, value_len) == 0) {
+        return false;
+      }
+
+      free(property->value);
+      if (track) {
+        property->value = malloc(value_len + 1);
+        memcpy(property->value, value, value_len + 1);
+        property->value_len = value_len;
+      } else {
+        free(property->key);
+        item->properties[i--] = item->properties[--item->num_properties];
+      }
+      track = false;
+    } else if (shadow_key_is_parent(property->key, property->key_len,
+                                    key, key_len                     )
+               || shadow_key_is_parent(key, key_len,
+                                       property->key, property->key_len)) {
+      shadow_property_destroy(property);
+      item->properties[i--] = item->properties[--item->num_properties];
+    }
+  }
+
+  if (!track) return true;
+
+  if (item->num_properties == item->properties_size) {
+    item->properties_size = item->properties_size
+                            ? 2 * item->properties_size
+                            : 8;
+    item->properties = realloc(item->properties,
+                               sizeof(struct shadow_property)
+                               * item->properties_size);
+  }
+
+  struct shadow_property* property = &item->properties[item->num_properties++];
+  property->key = malloc(key_len + 1);
+  memcpy(property->key, key, key_len);
+  property->key[key_len] = '\0';
+  property->key_len = key_len;
+  property->value = malloc(value_len + 1);
+  memcpy(property->value, value, value_len + 1);
+  property->value_len = value_len;
+  return true;
+}
+
+// Removes all unchanged assignments from the `--set` command in `message`,
+// whose properties start at fragment `first`. Returns false if no property
+// remains, i.e. the command does not need to be sent at all.
+static inline bool shadow_filter(struct shadow* shadow, struct message* message, const char* name, uint32_t first) {
+  if (!shadow->enabled) return true;
+  if (*name == '/') {
+    shadow_invalidate_all(shadow);
+    return true;
+  }
+
+  struct shadow_item* item = shadow_get_item(shadow, name, true);
+  uint32_t count = first;
+  uint32_t length = first < message->num_fragments
+                    ? message->fragments[first]
+                    : message->length;
+
+  for (uint32_t i = first; i < message->num_fragments; i++) {
+    char* property = message_fragment(message, i);
+    uint32_t len = message_fragment_length(message, i);
+    char* separator = memchr(property, '=', len);
+    uint32_t key_len = separator ? separator - property : len;
+    char* value = separator ? separator + 1 : property + len;
+
+    if (!shadow_item_update(item, property, key_len,
+                                  value, len - (value - property))) {
+      continue;
+    }
+
+    if (length != message->fragments[i])
+      memmove(message->buffer + length, property, len + 1);
+    message->fragments[count++] = length;
+    length += len + 1;
+  }
+
+  message->num_fragments = count;
+  message->length = length;
+  message->buffer[length] = '\0';
+  return count > first;
+}
@@ -1,12 +1,18 @@
 #include "mach.h"
 #include "parsing.h"
+#include "json.h"
 #include <lauxlib.h>
 #include <lua.h>
 #include <lualib.h>
 #include <CoreFoundation/CoreFoundation.h>
 #include <stdint.h>
+#include <regex.h>
 
-#include "stack.h"
+#include "message.h"
+#include "coalesce.h"
+#include "shadow.h"
+#include "cache.h"
+#include "callbacks.h"
 
 #define CMD_SUCCESS 1
 #define CMD_FAILURE 0
@@ -27,21 +33,30 @@ lua_State* g_state;
 #define REMOVE    "--remove"
 
 #define MACH_HELPER_FMT "git.lua.sketchybar%d"
+#define TEMPLATE_METATABLE "sketchybar.template"
+#define ENV_METATABLE "sketchybar.env"
 
-struct callback {
-  int callback_ref;
-  char* name;
-  char* event;
-};
+struct template {
+  // The key paths of the value slots, in positional order
+  struct message paths;
+  enum property_type* types;
 
-struct callbacks {
-  struct callback** callbacks;
-  uint32_t num_callbacks;
+  // Pre-encoded assignments sent along with every use of the template
+  struct message constants;
 };
 
-struct callbacks g_callbacks;
-static char* g_cmd = NULL;
-static uint32_t g_cmd_len = 0;
+static struct callbacks g_callbacks;
+static struct callback_names g_items;
+static struct callback_names g_events;
+static bool g_dispatching = false;
+static struct message g_transaction;
+static struct message g_coalesced;
+static struct coalescer g_coalescer;
+static bool g_transaction_active = false;
+static struct shadow g_shadow;
+static struct query_cache g_query_cache;
+static struct env_index g_env_index;
+static int g_env_blocks_ref = LUA_NOREF;
 static char g_bootstrap_name[64];
 mach_port_t g_port = 0;
 uint32_t g_uid_counter;
@@ -59,69 +74,79 @@ static char *luat_to_string(int type) {
   }
 }
 
-static char* sketchybar(struct stack* stack) {
-  uint32_t message_length;
-  char* message = stack_flatten_ttb(stack, &message_length);
-
-  if (!message && !g_cmd) return NULL;
-  if (g_cmd && stack) {
-    g_cmd = realloc(g_cmd, g_cmd_len + message_length);
-    memcpy(g_cmd + g_cmd_len, message, message_length);
-    g_cmd_len = g_cmd_len + message_length;
-    free(message);
+static char* sketchybar(struct message* message) {
+  if (g_transaction_active && message != &g_transaction) {
+    message_append_message(&g_transaction, message);
     return NULL;
-  } else if (g_cmd && !stack) {
-    message = g_cmd;
-    message_length = g_cmd_len;
   }
+  if (message->num_fragments == 0) return NULL;
 
+  // The message buffer is always NUL terminated, such that it can be handed
+  // to the transport directly including the final terminator
   if (!g_port) g_port = mach_get_bs_port(g_bs_lookup);
-  char message_format[message_length + 1];
-  memcpy(message_format, message, message_length);
-  message_format[message_length] = '\0';
   char* response = mach_send_message(g_port,
-                                     message_format,
-                                     message_length + 1,
+                                     message->buffer,
+                                     message->length + 1,
                                      true               );
   if (!response) {
     g_port = mach_get_bs_port(g_bs_lookup);
     response = mach_send_message(g_port,
-                                 message_format,
-                                 message_length + 1,
+                                 message->buffer,
+                                 message->length + 1,
                                  true               );
   }
+
+  // Nothing is known about the state of sketchybar after a failed message
+  if (!response) {
+    shadow_invalidate_all(&g_shadow);
+    query_cache_invalidate_all(&g_query_cache);
+  }
   return response;
 }
 
-static void sketchybar_call_log_and_cleanup(struct stack* stack) {
-  char* response = sketchybar(stack);
+static void sketchybar_call_log_and_cleanup(struct message* message) {
+  char* response = sketchybar(message);
   if (response) {
     if (strlen(response) > 0) printf("[i] sketchybar: %s\n", response);
     free(response);
   }
-  stack_destroy(stack);
+  message_clean(message);
 }
 
-static int transaction_create(lua_State* state) {
-  if (!g_cmd) {
-    g_cmd = malloc(1);
-    g_cmd_len = 0;
-    *g_cmd = '\0';
+static void sketchybar_set_log_and_cleanup(struct message* message) {
+  // Nothing is left to set if all properties were dropped
+  if (message->num_fragments <= 2) {
+    message_clean(message);
+    return;
+  }
+
+  query_cache_invalidate(&g_query_cache, message_fragment(message, 1));
+  if (!shadow_filter(&g_shadow, message, message_fragment(message, 1), 2)) {
+    message_clean(message);
+    return;
   }
+  sketchybar_call_log_and_cleanup(message);
+}
+
+static int transaction_create(lua_State* state) {
+  g_transaction_active = true;
   return 0;
 }
 
 static int transaction_commit(lua_State* state) {
   char* response = NULL;
-  if (g_cmd) {
-    response = sketchybar(NULL);
-    free(g_cmd);
+  if (g_transaction_active) {
+    g_transaction_active = false;
+    if (coalesce(&g_coalescer, &g_transaction, &g_coalesced))
+      response = sketchybar(&g_coalesced);
+    else
+      response = sketchybar(&g_transaction);
+    // The transaction buffer is kept around to be reused by the next one
+    message_reset(&g_transaction);
     if (response) {
       if (strlen(response) > 0) printf("[i] sketchybar: %s\n", response);
       free(response);
     }
-    g_cmd_len = 0;
-    g_cmd = NULL;
   }
   return 0;
 }
@@ -143,13 +168,13 @@ int animate(lua_State* state) {
 
   transaction_create(state);
 
-  struct stack* stack = stack_create();
-  stack_init(stack);
-  stack_push(stack, duration_str);
-  stack_push(stack, interp);
-  stack_push(stack, ANIMATE);
+  struct message message;
+  message_init(&message);
+  message_push(&message, ANIMATE);
+  message_push(&message, interp);
+  message_push(&message, duration_str);
 
-  sketchybar_call_log_and_cleanup(stack);
+  sketchybar_call_log_and_cleanup(&message);
 
   int error = lua_pcall(state, 0, 0, 0);
 
@@ -174,7 +199,62 @@ const char* get_name_from_state(lua_State* state) {
   return name;
 }
 
+// Encodes `set(<name>, <key_path>, <value>, ...)` straight from the stack
+static int set_key_values(lua_State* state) {
+  int top = lua_gettop(state);
+  if ((top - 1) % 2 != 0) {
+    char error[] = "[Lua] Error: expecting pairs of key paths and values "
+                   "as arguments for 'set'";
+    printf("%s\n", error);
+    return 0;
+  }
+
+  struct message message;
+  message_init(&message);
+
+  const char* name = get_name_from_state(state);
+
+  message_push(&message, SET);
+  message_push(&message, name);
+  for (int i = 2; i < top; i += 2) {
+    if (lua_type(state, i) != LUA_TSTRING
+        || lua_type(state, i + 1) == LUA_TTABLE) {
+      char error[] = "[Lua] Error: expecting a string key path and a "
+                     "non-table value as arguments for 'set'";
+      printf("%s\n", error);
+      message_clean(&message);
+      return 0;
+    }
+
+    size_t key_len;
+    const char* key = lua_tolstring(state, i, &key_len);
+    enum property_type type;
+    if (!parse_property_key(key, key_len, &type)) {
+      printf("[Lua] Error: unknown property '%s' as argument for 'set'\n",
+             key);
+      message_clean(&message);
+      return 0;
+    }
+
+    message_begin_fragment(&message);
+    message_append(&message, key, key_len);
+    message_append(&message, "=", 1);
+    parse_value(state, i + 1, type, &message);
+    message_end_fragment(&message);
+  }
+
+  sketchybar_set_log_and_cleanup(&message);
+  return 0;
+}
+
 int set(lua_State* state) {
+  if (lua_gettop(state) > 2
+      && lua_type(state, 2) == LUA_TSTRING
+      && (lua_type(state, 1) == LUA_TSTRING
+          || lua_type(state, 1) == LUA_TTABLE)) {
+    return set_key_values(state);
+  }
+
   if (lua_gettop(state) < 2
       || lua_type(state, -1) != LUA_TTABLE
       || (lua_type(state, 1) != LUA_TSTRING)
@@ -184,19 +264,138 @@ int set(lua_State* state) {
     printf("%s\n", error);
     return 0;
   }
-  struct stack* stack = stack_create();
-  stack_init(stack);
+  struct message message;
+  message_init(&message);
 
   const char* name = get_name_from_state(state);
 
-  parse_kv_table(state, NULL, stack);
+  message_push(&message, SET);
+  message_push(&message, name);
+  parse_kv_table(state, &message, true);
+  sketchybar_set_log_and_cleanup(&message);
+  return 0;
+}
+
+int template_set(lua_State* state) {
+  struct template* template = luaL_checkudata(state, 1, TEMPLATE_METATABLE);
+  if (lua_gettop(state) < 2
+      || (lua_type(state, 2) != LUA_TSTRING
+          && lua_type(state, 2) != LUA_TTABLE)) {
+    char error[] = "[Lua] Error: expecting a name or an item followed by the "
+                   "values as arguments for 'set' of a template";
+    printf("%s\n", error);
+    return 0;
+  }
 
-  stack_push(stack, name);
-  stack_push(stack, SET);
-  sketchybar_call_log_and_cleanup(stack);
+  const char* name;
+  if (lua_type(state, 2) == LUA_TTABLE) {
+    lua_getfield(state, 2, "name");
+    name = lua_tostring(state, -1);
+    lua_pop(state, 1);
+  } else {
+    name = lua_tostring(state, 2);
+  }
+  if (!name) return 0;
+
+  // Values are either given positionally or as a table keyed by key path
+  bool named = lua_type(state, 3) == LUA_TTABLE;
+
+  struct message message;
+  message_init(&message);
+  message_push(&message, SET);
+  message_push(&message, name);
+  message_append_message(&message, &template->constants);
+
+  for (uint32_t i = 0; i < template->paths.num_fragments; i++) {
+    int index = i + 3;
+    if (named) {
+      lua_getfield(state, 3, message_fragment(&template->paths, i));
+      index = -1;
+    } else if (index > lua_gettop(state)) {
+      break;
+    }
+
+    if (!lua_isnil(state, index)) {
+      message_begin_fragment(&message);
+      message_append(&message, message_fragment(&template->paths, i),
+                               message_fragment_length(&template->paths, i));
+      message_append(&message, "=", 1);
+      parse_value(state, index, template->types[i], &message);
+      message_end_fragment(&message);
+    }
+    if (named) lua_pop(state, 1);
+  }
+
+  sketchybar_set_log_and_cleanup(&message);
+  return 0;
+}
+
+static int template_gc(lua_State* state) {
+  struct template* template = luaL_checkudata(state, 1, TEMPLATE_METATABLE);
+  message_clean(&template->paths);
+  message_clean(&template->constants);
+  if (template->types) free(template->types);
+  template->types = NULL;
   return 0;
 }
 
+int prepare(lua_State* state) {
+  if (lua_gettop(state) < 1 || lua_type(state, 1) != LUA_TTABLE) {
+    char error[] = "[Lua] Error: expecting a table as the only argument "
+                   "for 'prepare'";
+    printf("%s\n", error);
+    return 0;
+  }
+
+  uint32_t num_slots = lua_rawlen(state, 1);
+  struct template* template = lua_newuserdatauv(state,
+                                                sizeof(struct template),
+                                                0                      );
+  message_init(&template->paths);
+  message_init(&template->constants);
+  template->types = malloc(sizeof(enum property_type)
+                           * (num_slots ? num_slots : 1)  );
+  luaL_setmetatable(state, TEMPLATE_METATABLE);
+
+  // The array part holds the key paths of the value slots
+  for (uint32_t i = 1; i <= num_slots; i++) {
+    lua_rawgeti(state, 1, i);
+    size_t path_len;
+    const char* path = lua_tolstring(state, -1, &path_len);
+    enum property_type type;
+    if (lua_type(state, -1) != LUA_TSTRING
+        || !parse_property_key(path, path_len, &type)) {
+      char error[] = "[Lua] Error: expecting the key paths of a template to "
+                     "be strings naming sketchybar properties";
+      printf("%s\n", error);
+      lua_pop(state, 2);
+      return 0;
+    }
+
+    template->types[template->paths.num_fragments] = type;
+    message_push_lstring(&template->paths, path, path_len);
+    lua_pop(state, 1);
+  }
+
+  // All remaining entries are constant properties and are encoded right away
+  lua_newtable(state);
+  lua_pushnil(state);
+  while (lua_next(state, 1)) {
+    if (lua_isinteger(state, -2)
+        && lua_tointeger(state, -2) >= 1
+        && lua_tointeger(state, -2) <= num_slots) {
+      lua_pop(state, 1);
+      continue;
+    }
+    lua_pushvalue(state, -2);
+    lua_insert(state, -2);
+    lua_settable(state, -4);
+  }
+  parse_kv_table(state, &template->constants, true);
+  lua_pop(state, 1);
+  return 1;
+}
+
 int defaults(lua_State* state) {
   if (lua_gettop(state) < 1 || lua_type(state, -1) != LUA_TTABLE) {
     char error[] = "[Lua] Error: expecting a table as an"
@@ -205,12 +404,12 @@ int defaults(lua_State* state) {
     return 0;
   }
 
-  struct stack* stack = stack_create();
-  stack_init(stack);
-  parse_kv_table(state, NULL, stack);
-  stack_push(stack, DEFAULT);
+  struct message message;
+  message_init(&message);
+  message_push(&message, DEFAULT);
+  parse_kv_table(state, &message, true);
 
-  sketchybar_call_log_and_cleanup(stack);
+  sketchybar_call_log_and_cleanup(&message);
   return 0;
 }
 
@@ -221,15 +420,169 @@ int bar(lua_State* state) {
     printf("%s\n", error);
     return 0;
   }
-  struct stack* stack = stack_create();
-  stack_init(stack);
-  parse_kv_table(state, NULL, stack);
-  stack_push(stack, BAR);
+  struct message message;
+  message_init(&message);
+  message_push(&message, BAR);
+  parse_kv_table(state, &message, true);
+  query_cache_invalidate(&g_query_cache, "bar");
 
-  sketchybar_call_log_and_cleanup(stack);
+  sketchybar_call_log_and_cleanup(&message);
   return 0;
 }
 
+// The env table passed to event callbacks is filled lazily: a copy of the
+// raw env block is attached to the table in a weak keyed registry table, and
+// every value is only decoded once it is first read, after which it is
+// stored in the table itself.
+struct env_block {
+  uint32_t num_entries;
+  struct env_entry entries[];
+};
+
+#ifdef STATS
+// Counts of the env values read during an event which were decoded as JSON,
+// which json_sniff ruled out, and which failed to decode after all
+static struct {
+  uint32_t parsed;
+  uint32_t avoided;
+  uint32_t failed;
+} g_env_stats;
+#endif
+
+static void env_block_push_value(lua_State* state, struct env_entry* entry) {
+  const char* end = entry->value + entry->value_len;
+  if (json_sniff(entry->value, end)) {
+#ifdef STATS
+    g_env_stats.parsed++;
+#endif
+    bool decoded = json_decode(state, entry->value, end);
+    json_arena_reset();
+    if (decoded) return;
+#ifdef STATS
+    g_env_stats.failed++;
+#endif
+  }
+#ifdef STATS
+  else g_env_stats.avoided++;
+#endif
+  lua_pushlstring(state, entry->value, entry->value_len);
+}
+
+static int env_table_index(lua_State* state) {
+  if (lua_type(state, 2) != LUA_TSTRING) return 0;
+  lua_pushvalue(state, 1);
+  lua_rawget(state, lua_upvalueindex(1));
+  struct env_block* block = lua_touserdata(state, -1);
+  if (!block) return 0;
+
+  size_t key_len;
+  const char* key = lua_tolstring(state, 2, &key_len);
+  for (uint32_t i = 0; i < block->num_entries; i++) {
+    struct env_entry* entry = &block->entries[i];
+    if (entry->key_len == key_len && memcmp(entry->key, key, key_len) == 0) {
+      env_block_push_value(state, entry);
+      lua_pushvalue(state, 2);
+      lua_pushvalue(state, -2);
+      lua_rawset(state, 1);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int env_table_next(lua_State* state) {
+  lua_settop(state, 2);
+  if (lua_next(state, 1)) return 2;
+  lua_pushnil(state);
+  return 1;
+}
+
+static int env_table_pairs(lua_State* state) {
+  lua_pushvalue(state, 1);
+  lua_rawget(state, lua_upvalueindex(1));
+  struct env_block* block = lua_touserdata(state, -1);
+
+  // All values not yet read are decoded, the block is no longer needed then
+  if (block) {
+    for (uint32_t i = 0; i < block->num_entries; i++) {
+      struct env_entry* entry = &block->entries[i];
+      json_push_key(state, entry->key, entry->key_len);
+      if (lua_rawget(state, 1) == LUA_TNIL) {
+        json_push_key(state, entry->key, entry->key_len);
+        env_block_push_value(state, entry);
+        lua_rawset(state, 1);
+      }
+      lua_pop(state, 1);
+    }
+    lua_pushvalue(state, 1);
+    lua_pushnil(state);
+    lua_rawset(state, lua_upvalueindex(1));
+  }
+
+  lua_pushcfunction(state, env_table_next);
+  lua_pushvalue(state, 1);
+  lua_pushnil(state);
+  return 3;
+}
+
+static void env_table_register(lua_State* state) {
+  lua_newtable(state);
+  lua_createtable(state, 0, 1);
+  lua_pushliteral(state, "k");
+  lua_setfield(state, -2, "__mode");
+  lua_setmetatable(state, -2);
+
+  // Env tables should still look like plain tables to tostring
+  luaL_newmetatable(state, ENV_METATABLE);
+  lua_pushnil(state);
+  lua_setfield(state, -2, "__name");
+  lua_pushvalue(state, -2);
+  lua_pushcclosure(state, env_table_index, 1);
+  lua_setfield(state, -2, "__index");
+  lua_pushvalue(state, -2);
+  lua_pushcclosure(state, env_table_pairs, 1);
+  lua_setfield(state, -2, "__pairs");
+  lua_pop(state, 1);
+
+  g_env_blocks_ref = luaL_ref(state, LUA_REGISTRYINDEX);
+}
+
+static void env_table_push(lua_State* state, struct env_index* index, env env, size_t size) {
+  size_t entries_size = sizeof(struct env_entry) * index->num_entries;
+  struct env_block* block = lua_newuserdatauv(state, sizeof(struct env_block)
+                                                     + entries_size
+                                                     + size,
+                                                     0                       );
+
+  // Userdata never moves, so the entries can point into the copied block
+  char* copy = (char*)block->entries + entries_size;
+  memcpy(copy, env, size);
+  block->num_entries = index->num_entries;
+  for (uint32_t i = 0; i < index->num_entries; i++) {
+    block->entries[i] = index->entries[i];
+    block->entries[i].key = copy + (index->entries[i].key - env);
+    block->entries[i].value = copy + (index->entries[i].value - env);
+  }
+
+  lua_newtable(state);
+  luaL_setmetatable(state, ENV_METATABLE);
+  lua_rawgeti(state, LUA_REGISTRYINDEX, g_env_blocks_ref);
+  lua_pushvalue(state, -2);
+  lua_pushvalue(state, -4);
+  lua_rawset(state, -3);
+  lua_pop(state, 1);
+  lua_remove(state, -2);
+}
+
+// Releases the refs of removed handlers, unless they may still be called by
+// the event currently dispatched
+static void subscribe_release_refs(void) {
+  if (g_dispatching) return;
+  for (uint32_t i = 0; i < g_callbacks.num_released; i++)
+    luaL_unref(g_state, LUA_REGISTRYINDEX, g_callbacks.released[i]);
+  g_callbacks.num_released = 0;
+}
+
 void callback_function(char* message, size_t len) {
   if (len >= 1 + 2*sizeof(int) && message && *message == '\x07') {
     int callback_ref = 0;
@@ -242,6 +595,7 @@ void callback_function(char* message, size_t len) {
       lua_pushstring(g_state, response);
     }
     lua_pushinteger(g_state, exit_code);
+    json_arena_reset();
 
     transaction_create(g_state);
     int error = lua_pcall(g_state, 2, 0, 0);
@@ -253,90 +607,223 @@ void callback_function(char* message, size_t len) {
     return;
   }
   env env = message;
-  char* name = env_get_value_for_key(env, "NAME");
-  char* sender = env_get_value_for_key(env, "SENDER");
-
-  for (int i = 0; i < g_callbacks.num_callbacks; i++) {
-    if (strcmp(g_callbacks.callbacks[i]->name, name) == 0
-        && strcmp(g_callbacks.callbacks[i]->event, sender) == 0) {
-
-      lua_rawgeti(g_state, LUA_REGISTRYINDEX,
-                           g_callbacks.callbacks[i]->callback_ref);
-
-      lua_newtable(g_state);
-      struct key_value_pair kv = { NULL, NULL };
-      do {
-        kv = env_get_next_key_value_pair(env, kv);
-        if (kv.key && kv.value) {
-          lua_pushstring(g_state, kv.key);
-          if (!json_to_lua_table(g_state, kv.value)) {
-            lua_pushstring(g_state, kv.value);
-          }
-
-          lua_settable(g_state,-3);
-        }
-      } while(kv.key && kv.value);
+  env_index_build(&g_env_index, env, len);
+  struct env_entry* name = env_index_find(&g_env_index, "NAME");
+  struct env_entry* sender = env_index_find(&g_env_index, "SENDER");
+
+  // Wildcard handlers only run for items known to the module
+  bool known = g_callbacks.num_wildcard_names
+               && name
+               && callback_names_contains(&g_items, name->value,
+                                                    name->value_len);
+
+  uint32_t num_handlers = callbacks_match(&g_callbacks,
+                                          name ? name->value : "",
+                                          name ? name->value_len : 0,
+                                          sender ? sender->value : "",
+                                          sender ? sender->value_len : 0,
+                                          known                          );
+  if (!num_handlers) return;
+
+  // All handlers of the event share one env table and one transaction
+  bool wants_env = false;
+  for (uint32_t i = 0; i < num_handlers; i++)
+    wants_env |= g_callbacks.matched[i].wants_env;
+  if (wants_env) env_table_push(g_state, &g_env_index, env, len);
 
-      transaction_create(g_state);
-      int error = lua_pcall(g_state, 1, 0, 0);
+  transaction_create(g_state);
+  g_dispatching = true;
+  for (uint32_t i = 0; i < num_handlers; i++) {
+    struct callback_handler* handler = &g_callbacks.matched[i];
+    lua_rawgeti(g_state, LUA_REGISTRYINDEX, handler->callback_ref);
+    if (handler->wants_env) lua_pushvalue(g_state, -2);
 
-      if (error && lua_gettop(g_state)) {
-        printf("[!] Lua: %s\n", lua_tostring(g_state, -1));
-      }
-      transaction_commit(g_state);
-      break;
+    if (lua_pcall(g_state, handler->wants_env ? 1 : 0, 0, 0)) {
+      printf("[!] Lua: %s\n", lua_tostring(g_state, -1));
+      lua_pop(g_state, 1);
     }
   }
+  g_dispatching = false;
+  transaction_commit(g_state);
+  if (wants_env) lua_pop(g_state, 1);
+  subscribe_release_refs();
+
+#ifdef STATS
+  printf("[i] env: %u values parsed, %u parses avoided, %u failed\n",
+         g_env_stats.parsed,
+         g_env_stats.avoided,
+         g_env_stats.failed                                        );
+  memset(&g_env_stats, 0, sizeof(g_env_stats));
+#endif
 }
 
-void subscribe_register_event(const char* name, const char* event, int callback_ref) {
-  struct stack* stack = stack_create();
-  char mach_helper[strlen(g_bootstrap_name) + 16];
-  snprintf(mach_helper, strlen(g_bootstrap_name) + 16, "mach_helper=%s",
-                                                        g_bootstrap_name);
-  char empy_script[] = { "script=" };
-  char event_op[] = { "event" };
-
-  stack_init(stack);
-  stack_push(stack, mach_helper);
-  stack_push(stack, empy_script);
-  stack_push(stack, name);
-  stack_push(stack, SET);
-  stack_push(stack, event);
-  stack_push(stack, event_op);
-  stack_push(stack, ADD);
-  sketchybar_call_log_and_cleanup(stack);
-
-  int index = -1;
-  for (int i = 0; i < g_callbacks.num_callbacks; i++) {
-    if (strcmp(g_callbacks.callbacks[i]->name, name) == 0
-        && strcmp(g_callbacks.callbacks[i]->event, event) == 0) {
-      index = i;
-      break;
+static const char* g_builtin_events[] = {
+  "front_app_switched", "space_change", "space_windows_change",
+  "display_change", "volume_change", "brightness_change",
+  "power_source_change", "wifi_change", "media_change", "system_will_sleep",
+  "system_woke", "mouse.entered", "mouse.exited", "mouse.entered.global",
+  "mouse.exited.global", "mouse.clicked", "mouse.scrolled",
+  "mouse.scrolled.global", "routine", "forced"
+};
+
+static bool subscribe_contains(struct message* names, const char* name) {
+  for (uint32_t i = 0; i < names->num_fragments; i++) {
+    if (strcmp(message_fragment(names, i), name) == 0) return true;
+  }
+  return false;
+}
+
+// Appends the events matching `event` to `events` unless they are already
+// contained, wildcard patterns are expanded to all matching events known to
+// the module
+static void subscribe_expand_event(struct message* events, const char* event) {
+  uint32_t event_len = strlen(event);
+  if (!callbacks_is_pattern(event, event_len)) {
+    if (!subscribe_contains(events, event)) message_push(events, event);
+    return;
+  }
+
+  for (uint32_t i = 0; i < g_events.num_names; i++) {
+    const char* known = g_events.names[i].name;
+    if (callbacks_pattern_matches(event, event_len, known, strlen(known))
+        && !subscribe_contains(events, known)) {
+      message_push(events, known);
     }
   }
+}
 
-  if (index < 0) {
-    g_callbacks.callbacks = realloc(g_callbacks.callbacks,
-                                    sizeof(struct callback*)
-                                    * ++g_callbacks.num_callbacks);
+// Appends the commands subscribing the item to the events, sketchybar only
+// delivers events to the module for items with its mach helper set. Both
+// change the query response of the item.
+static void subscribe_append_item(struct message* message, const char* name, struct message* events) {
+  query_cache_invalidate(&g_query_cache, name);
+  message_push(message, SET);
+  message_push(message, name);
+  message_push(message, "script=");
+  message_begin_fragment(message);
+  message_append(message, "mach_helper=", 12);
+  message_append(message, g_bootstrap_name, strlen(g_bootstrap_name));
+  message_end_fragment(message);
+
+  message_push(message, SUBSCRIBE);
+  message_push(message, name);
+  for (uint32_t i = 0; i < events->num_fragments; i++) {
+    message_push(message, message_fragment(events, i));
+  }
+}
 
-    struct callback* callback = malloc(sizeof(struct callback));
-    m_clone(callback->name, name);
-    m_clone(callback->event, event);
-    callback->callback_ref = callback_ref;
-    g_callbacks.callbacks[g_callbacks.num_callbacks - 1] = callback;
-  } else {
-    g_callbacks.callbacks[index]->callback_ref = callback_ref;
+static void subscribe_append_events(struct message* message, struct message* events) {
+  for (uint32_t i = 0; i < events->num_fragments; i++) {
+    message_push(message, ADD);
+    message_push(message, "event");
+    message_push(message, message_fragment(events, i));
+  }
+}
+
+// Subscribes an item which is new to the module to the events of all
+// subscriptions of the wildcard item
+static void subscribe_new_item(const char* name) {
+  if (!g_callbacks.num_wildcard_names) return;
+
+  struct message events;
+  message_init(&events);
+  for (uint32_t i = 0; i < g_callbacks.num_callbacks; i++) {
+    struct callback* callback = &g_callbacks.callbacks[i];
+    if (callbacks_is_wildcard(callback->name, callback->name_len))
+      subscribe_expand_event(&events, callback->event);
+  }
+
+  if (events.num_fragments) {
+    struct message message;
+    message_init(&message);
+    subscribe_append_item(&message, name, &events);
+    sketchybar_call_log_and_cleanup(&message);
   }
+  message_clean(&events);
+}
+
+// Subscribes the items of all subscriptions with a pattern matching an event
+// which is new to the module to this event
+static void subscribe_new_event(const char* event) {
+  if (!g_callbacks.num_patterns) return;
+
+  struct message events;
+  message_init(&events);
+  message_push(&events, event);
+
+  struct message names;
+  message_init(&names);
+  bool all_items = false;
+
+  uint32_t event_len = strlen(event);
+  for (uint32_t i = 0; i < g_callbacks.num_callbacks; i++) {
+    struct callback* callback = &g_callbacks.callbacks[i];
+    if (!callbacks_is_pattern(callback->event, callback->event_len)
+        || !callbacks_pattern_matches(callback->event, callback->event_len,
+                                      event, event_len                    )) {
+      continue;
+    }
 
-  stack = stack_create();
-  stack_init(stack);
-  stack_push(stack, event);
-  stack_push(stack, name);
-  stack_push(stack, SUBSCRIBE);
+    if (callbacks_is_wildcard(callback->name, callback->name_len))
+      all_items = true;
+    else if (!subscribe_contains(&names, callback->name))
+      message_push(&names, callback->name);
+  }
 
-  sketchybar_call_log_and_cleanup(stack);
+  if (all_items || names.num_fragments) {
+    struct message message;
+    message_init(&message);
+    subscribe_append_events(&message, &events);
+    if (all_items) {
+      for (uint32_t i = 0; i < g_items.num_names; i++)
+        subscribe_append_item(&message, g_items.names[i].name, &events);
+    } else {
+      for (uint32_t i = 0; i < names.num_fragments; i++) {
+        subscribe_append_item(&message, message_fragment(&names, i),
+                                        &events                     );
+      }
+    }
+    sketchybar_call_log_and_cleanup(&message);
+  }
+  message_clean(&names);
+  message_clean(&events);
+}
+
+// Registers the handler for all events and sends the subscriptions to
+// sketchybar in a single message
+static void subscribe_register_events(const char* name, struct message* events, int callback_ref, bool wants_env) {
+  if (!callbacks_is_wildcard(name, strlen(name))
+      && callback_names_add(&g_items, name)) {
+    subscribe_new_item(name);
+  }
+
+  struct message expanded;
+  message_init(&expanded);
+  for (uint32_t i = 0; i < events->num_fragments; i++) {
+    const char* event = message_fragment(events, i);
+    callbacks_add(&g_callbacks, name, event, callback_ref, wants_env);
+    if (!callbacks_is_pattern(event, strlen(event))
+        && callback_names_add(&g_events, event)) {
+      subscribe_new_event(event);
+    }
+    subscribe_expand_event(&expanded, event);
+  }
+
+  struct message message;
+  message_init(&message);
+  subscribe_append_events(&message, &expanded);
+  if (callbacks_is_wildcard(name, strlen(name))) {
+    for (uint32_t i = 0; i < g_items.num_names; i++)
+      subscribe_append_item(&message, g_items.names[i].name, &expanded);
+  } else {
+    subscribe_append_item(&message, name, &expanded);
+  }
+
+  if (expanded.num_fragments && message.num_fragments)
+    sketchybar_call_log_and_cleanup(&message);
+  else
+    message_clean(&message);
+  message_clean(&expanded);
 }
 
 int subscribe(lua_State* state) {
@@ -352,22 +839,24 @@ int subscribe(lua_State* state) {
   }
 
   const char* name = get_name_from_state(state);
+  lua_Debug info;
+  lua_pushvalue(state, -1);
+  lua_getinfo(state, ">u", &info);
+  bool wants_env = info.nparams > 0 || info.isvararg;
+
   lua_pushvalue(state, -1);
   int callback_ref = luaL_ref(state, LUA_REGISTRYINDEX);
   lua_pop(state, 1);
 
+  struct message events;
+  message_init(&events);
   if (lua_type(state, 2) == LUA_TSTRING) {
-    const char* event = lua_tostring(state, 2);
-    subscribe_register_event(name, event, callback_ref);
+    message_push(&events, lua_tostring(state, 2));
   } else if (lua_type(state, 2) == LUA_TTABLE) {
-    struct stack* stack = stack_create();
-    stack_init(stack);
-    parse_table_values_to_stack(state, 2, stack);
-    for (int i = 0; i < stack->num_values; i++) {
-      subscribe_register_event(name, stack->value[i], callback_ref);
-    }
-    stack_destroy(stack);
+    parse_table_values_to_message(state, 2, &events);
   }
+  subscribe_register_events(name, &events, callback_ref, wants_env);
+  message_clean(&events);
   return 0;
 }
 
@@ -382,26 +871,144 @@ int query(lua_State* state) {
   if (lua_type(state, 1) == LUA_TTABLE) {
     query = get_name_from_state(state);
   } else {
-    query = lua_tostring(state, -1);
+    query = lua_tostring(state, 1);
+  }
+  bool lazy = lua_toboolean(state, 2);
+
+  // Cached responses are served without interrupting the transaction
+  double now = CFAbsoluteTimeGetCurrent();
+  struct query_cache_entry* cached = query_cache_lookup(&g_query_cache,
+                                                        query,
+                                                        now           );
+  if (cached) {
+    if (!lazy) {
+      bool decoded = json_to_lua_table(state, cached->response);
+      json_arena_reset();
+      return decoded ? 1 : 0;
+    }
+
+    char* response = malloc(cached->response_len + 1);
+    memcpy(response, cached->response, cached->response_len + 1);
+    return json_lazy_push(state, response) ? 1 : 0;
   }
 
-  struct stack* stack = stack_create();
-  stack_init(stack);
-  stack_push(stack, query);
-  stack_push(stack, QUERY);
-  bool transaction_interrupted = g_cmd != NULL;
+  struct message message;
+  message_init(&message);
+  message_push(&message, QUERY);
+  message_push(&message, query);
+  shadow_invalidate(&g_shadow, query);
+  bool transaction_interrupted = g_transaction_active;
   transaction_commit(state);
-  char* response = sketchybar(stack);
-  stack_destroy(stack);
+  char* response = sketchybar(&message);
+  message_clean(&message);
   if (transaction_interrupted) transaction_create(state);
   if (response) {
-    json_to_lua_table(state, response);
+    // The lazy proxy takes ownership of the response
+    if (lazy) {
+      if (!json_lazy_push(state, response)) return 0;
+      query_cache_store(&g_query_cache, query, response, strlen(response),
+                                                          now             );
+      return 1;
+    }
+
+    if (json_to_lua_table(state, response)) {
+      query_cache_store(&g_query_cache, query, response, strlen(response),
+                                                          now             );
+    }
+    json_arena_reset();
     free(response);
     return 1;
   }
 
   return 0;
 }
+// Queries all given items with a single message and returns a table of the
+// results keyed by item name
+int query_many(lua_State* state) {
+  if (lua_gettop(state) < 1 || lua_type(state, 1) != LUA_TTABLE) {
+    char error[] = "[Lua] Error: expecting a table of names or items as the "
+                   "only argument for 'query_many'";
+    printf("%s\n", error);
+    return 0;
+  }
+
+  int count = lua_rawlen(state, 1);
+  lua_createtable(state, 0, count);
+  int results = lua_gettop(state);
+
+  struct message message;
+  message_init(&message);
+  double now = CFAbsoluteTimeGetCurrent();
+  for (int i = 1; i <= count; i++) {
+    lua_rawgeti(state, 1, i);
+    if (lua_type(state, -1) == LUA_TTABLE) lua_getfield(state, -1, "name");
+    const char* name = lua_tostring(state, -1);
+    struct query_cache_entry* cached = query_cache_lookup(&g_query_cache,
+                                                          name,
+                                                          now           );
+    if (cached) {
+      if (json_to_lua_table(state, cached->response))
+        lua_setfield(state, results, name);
+    } else if (name) {
+      message_push(&message, QUERY);
+      message_push(&message, name);
+      shadow_invalidate(&g_shadow, name);
+    }
+    lua_settop(state, results);
+  }
+  json_arena_reset();
+
+  if (message.num_fragments == 0) {
+    message_clean(&message);
+    return 1;
+  }
+
+  bool transaction_interrupted = g_transaction_active;
+  transaction_commit(state);
+  char* response = sketchybar(&message);
+  if (transaction_interrupted) transaction_create(state);
+  if (!response) {
+    message_clean(&message);
+    return 1;
+  }
+
+  // The responses are concatenated in the order of the queries, a failed
+  // query is answered with a single line error (e.g. "[!] Query: ...")
+  // instead of a JSON document
+  const char* cursor = response;
+  const char* end = response + strlen(response);
+  for (uint32_t i = 1; i < message.num_fragments && cursor < end; i += 2) {
+    const char* name = message_fragment(&message, i);
+    while (cursor < end && (unsigned char)*cursor <= 32) cursor++;
+
+    const char* document = cursor;
+    if (cursor < end && (*cursor == '{' || *cursor == '['))
+      cursor = json_decode(state, document, end);
+    else
+      cursor = NULL;
+
+    if (cursor) {
+      query_cache_store(&g_query_cache, name, document, cursor - document,
+                                                        now               );
+      lua_setfield(state, results, name);
+    } else if (json_sniff(document, end)) {
+      // Documents span many lines, continue after the brackets of the
+      // document. If they do not match up, the remaining responses can not
+      // be attributed to their items.
+      cursor = json_document_end(document, end);
+      if (!cursor) break;
+    } else {
+      cursor = memchr(document, '\n', end - document);
+      cursor = cursor ? cursor + 1 : end;
+    }
+  }
+
+  json_arena_reset();
+  free(response);
+  message_clean(&message);
+  return 1;
+}
+
 void generate_uid(char* buffer) {
   snprintf(buffer, 64, "item_%d", g_uid_counter++);
 }
@@ -425,15 +1032,23 @@ int push(lua_State *state) {
 
   // Technically this method will work regardless, so all we need to do 
   // is ensure a valid input state before we reach this part:
-  struct stack *stack = stack_create();
-  stack_init(stack);
+  struct message message;
+  message_init(&message);
 
   const char *name = get_name_from_state(state);
-  parse_table_values_to_stack(state, 2, stack);
-
-  stack_push(stack, name);
-  stack_push(stack, PUSH);
-  sketchybar_call_log_and_cleanup(stack);
+  message_push(&message, PUSH);
+  message_push(&message, name);
+  query_cache_invalidate(&g_query_cache, name);
+
+  // Values are sent newest first
+  for (int i = lua_rawlen(state, 2); i > 0; i--) {
+    lua_rawgeti(state, 2, i);
+    size_t value_len;
+    const char* value = lua_tolstring(state, -1, &value_len);
+    if (value) message_push_lstring(&message, value, value_len);
+    lua_pop(state, 1);
+  }
+  sketchybar_call_log_and_cleanup(&message);
 
   return 0;
 }
@@ -447,8 +1062,8 @@ int add(lua_State* state) {
     return 0;
   }
 
-  struct stack* stack = stack_create();
-  stack_init(stack);
+  struct message message;
+  message_init(&message);
   const char* type = lua_tostring(state, 1);
 
 
@@ -461,19 +1076,28 @@ int add(lua_State* state) {
     lua_insert(state, 2);
   }
 
+  message_push(&message, ADD);
+  message_push(&message, type);
+  message_push(&message, name);
+  query_cache_invalidate(&g_query_cache, name);
+  // The bar lists all of its items and the events query all custom events
+  query_cache_invalidate(&g_query_cache, strcmp(type, "event") == 0
+                                         ? "events"
+                                         : "bar"                  );
+
   if (strcmp(type,"item") == 0
       || strcmp(type, "alias") == 0
       || strcmp(type, "space") == 0) {
     // "Regular" items with name and position
     const char* position = { "left" };
-    stack_push(stack, position);
+    message_push(&message, position);
   } else if (strcmp(type, "event") == 0) {
     // Ensure event name is a string:
     if (lua_type(state, 2) != LUA_TSTRING) {
       char error[] = "[Lua] Error: expecting a 'string' as second argument"
                      " for 'add' when the type is 'event'";
       printf("%s\n", error);
-      stack_destroy(stack);
+      message_clean(&message);
       return 0;
     }
 
@@ -484,11 +1108,11 @@ int add(lua_State* state) {
         char error[] = "[Lua] Error: expecting a 'string' as third argument"
                        " for 'add' when the type is 'event'";
         printf("%s\n", error);
-        stack_destroy(stack);
+        message_clean(&message);
         return 0;
       } else {
         // Else process DistributionNotification:
-        stack_push(stack, lua_tostring(state, 3));
+        message_push(&message, lua_tostring(state, 3));
       }
     }
   } else if (strcmp(type, "slider") == 0) {
@@ -496,50 +1120,50 @@ int add(lua_State* state) {
       char error[] = "[Lua] Error: expecting at least 3 arguments for 'add' when "
                      "the type is 'slider'";
       printf("%s. Recieved: %d\n", error, lua_gettop(state));
-      stack_destroy(stack);
+      message_clean(&message);
       return 0;
     } else if (lua_type(state, 3) != LUA_TNUMBER) {
       char error[] = "[Lua] Error: expecting a 'number' for the 3rd argument "
                      "'add' when type is 'slider'"; 
       printf("%s. Found %s\n", error, luat_to_string(lua_type(state, 3)));
-      stack_destroy(stack);
+      message_clean(&message);
       return 0;
     }
 
-    // Push the slider width to the stack 
-    stack_push(stack, lua_tostring(state, 3));
-
-    // And the position as always.
+    // The position as always.
     const char *position = { "left" };
-    stack_push(stack, position);
+    message_push(&message, position);
+
+    // And the slider width
+    message_push(&message, lua_tostring(state, 3));
 
   } else if (strcmp(type, "graph") == 0) {
     if (lua_gettop(state) < 3) {
       char error[] = "[Lua] Error: expecting at least 3 arguments for 'add' when "
                      "the type is 'graph'";
       printf("%s. Recieved: %d\n", error, lua_gettop(state));
-      stack_destroy(stack);
+      message_clean(&message);
       return 0;
     } else if (lua_type(state, 3) != LUA_TNUMBER) {
       char error[] = "[Lua] Error: expecting a 'number' for the 3rd argument "
                      "'add' when type is 'graph'"; 
       printf("%s. Found %s\n", error, luat_to_string(lua_type(state, 3)));
-      stack_destroy(stack);
+      message_clean(&message);
       return 0;
     } else if (lua_type(state, 4) != LUA_TTABLE) {
       char error[] = "[Lua] Error: expecting a 'table' for the 4th argument "
                      "'add' when type is 'graph'"; 
       printf("%s. Found %s\n", error, luat_to_string(lua_type(state, 3)));
-      stack_destroy(stack);
+      message_clean(&message);
       return 0;
     }
     
-    // Push the width to the stack
-    stack_push(stack, lua_tostring(state, 3));
-
     // Set the position for the graph by default:
     const char *position = { "left" };
-    stack_push(stack, position);
+    message_push(&message, position);
+
+    // Push the width to the message
+    message_push(&message, lua_tostring(state, 3));
 
   } else if (strcmp(type, "bracket") == 0) {
     // A bracket takes a list of member items instead of a position
@@ -547,28 +1171,31 @@ int add(lua_State* state) {
       char error[] = "[Lua] Error: expecting a lua table as third argument"
                      " for 'add', when the type is 'bracket'";
       printf("%s\n", error);
-      stack_destroy(stack);
+      message_clean(&message);
       return 0;
     }
 
     lua_pushnil(state);
     while (lua_next(state, 3)) {
       const char* member = lua_tostring(state, -1);
-      stack_push(stack, member);
+      message_push(&message, member);
       lua_pop(state, 1);
     }
   } else {
     char error[] = "[Lua] Error: Item type not supported yet, create case for"
                     " it in src/sketchybar.c";
     printf("%s\n", error);
-    stack_destroy(stack);
+    message_clean(&message);
     return 0;
   }
 
-  stack_push(stack, name);
-  stack_push(stack, type);
-  stack_push(stack, ADD);
-  sketchybar_call_log_and_cleanup(stack);
+  sketchybar_call_log_and_cleanup(&message);
+
+  if (strcmp(type, "event") == 0) {
+    if (callback_names_add(&g_events, name)) subscribe_new_event(name);
+  } else if (callback_names_add(&g_items, name)) {
+    subscribe_new_item(name);
+  }
 
   // If a table is presented as the last argument, we parse it as if it
   // was passed to the set domain.
@@ -599,6 +1226,38 @@ int add(lua_State* state) {
   return 1;
 }
 
+static bool remove_name_matches(const char* name, void* context) {
+  return strcmp(name, context) == 0;
+}
+
+static bool remove_regex_matches(const char* name, void* context) {
+  return regexec(context, name, 0, NULL, 0) == 0;
+}
+
+// Forgets the removed items, such that wildcard subscriptions no longer
+// target them and their handlers are released. Regex targets are matched
+// against all items known to the module.
+static void subscribe_remove_items(const char* name) {
+  if (!name) return;
+
+  if (*name == '/') {
+    char pattern[256];
+    snprintf(pattern, sizeof(pattern), "%s", name + 1);
+    uint32_t length = strlen(pattern);
+    if (length && pattern[length - 1] == '/') pattern[length - 1] = '\0';
+
+    regex_t regex;
+    if (regcomp(&regex, pattern, REG_EXTENDED | REG_NOSUB) != 0) return;
+    callback_names_remove(&g_items, remove_regex_matches, &regex);
+    callbacks_remove(&g_callbacks, remove_regex_matches, &regex);
+    regfree(&regex);
+  } else {
+    callback_names_remove(&g_items, remove_name_matches, (void*)name);
+    callbacks_remove(&g_callbacks, remove_name_matches, (void*)name);
+  }
+  subscribe_release_refs();
+}
+
 int remove_sbar(lua_State* state) {
   if (lua_gettop(state) < 1) {
     char error[] = "[Lua] Error: expecting at least one argument "
@@ -608,11 +1267,15 @@ int remove_sbar(lua_State* state) {
   }
 
   const char* name = get_name_from_state(state);
-  struct stack* stack = stack_create();
-  stack_init(stack);
-  stack_push(stack, name);
-  stack_push(stack, REMOVE);
-  sketchybar_call_log_and_cleanup(stack);
+  struct message message;
+  message_init(&message);
+  message_push(&message, REMOVE);
+  message_push(&message, name);
+  shadow_invalidate(&g_shadow, name);
+  query_cache_invalidate(&g_query_cache, name);
+  query_cache_invalidate(&g_query_cache, "bar");
+  subscribe_remove_items(name);
+  sketchybar_call_log_and_cleanup(&message);
   return 0;}
 
 static void orphan_check() {
@@ -621,10 +1284,10 @@ static void orphan_check() {
 
 int event_loop(lua_State* state) {
   g_state = state;
-  struct stack* stack = stack_create();
-  stack_init(stack);
-  stack_push(stack, UPDATE);
-  sketchybar_call_log_and_cleanup(stack);
+  struct message message;
+  message_init(&message);
+  message_push(&message, UPDATE);
+  sketchybar_call_log_and_cleanup(&message);
   alarm(0);
   mach_server_begin(&g_mach_server, callback_function);
   CFRunLoopTimerRef orphan_timer
@@ -649,15 +1312,17 @@ int hotload(lua_State* state) {
     return 0;
   }
   g_state = state;
-  struct stack* stack = stack_create();
-  stack_init(stack);
+  struct message message;
+  message_init(&message);
+  message_push(&message, HOTLOAD);
+  shadow_invalidate_all(&g_shadow);
+  query_cache_invalidate_all(&g_query_cache);
   if (lua_toboolean(state, 1)) {
-    stack_push(stack, "on");
+    message_push(&message, "on");
   } else {
-    stack_push(stack, "off");
+    message_push(&message, "off");
   }
-  stack_push(stack, HOTLOAD);
-  sketchybar_call_log_and_cleanup(stack);
+  sketchybar_call_log_and_cleanup(&message);
   return 0;
 }
 
@@ -670,31 +1335,72 @@ int trigger(lua_State *state) {
     return 0;
   }
 
-  // Push the event name onto the stack:
-  struct stack *stack = stack_create();
-  stack_init(stack);
-
   const char* event = lua_tostring(state, 1);
 
   if (lua_gettop(state) > 1 && lua_type(state, 2) != LUA_TTABLE) {
     char error[] = "[Lua] Error: expecting a table as the second argument for "
                    "'trigger'";
     printf("%s\n", error);
-    stack_destroy(stack);
     return 0;
+  }
+
+  // No errors, push the event name onto the message:
+  struct message message;
+  message_init(&message);
+  message_push(&message, TRIGGER);
+  message_push(&message, event);
+
+  if (lua_gettop(state) > 2 && lua_toboolean(state, 3)) {
+    // Nested tables are sent as JSON values instead of being flattened:
+    lua_pushnil(state);
+    while (lua_next(state, 2)) {
+      size_t key_len;
+      lua_pushvalue(state, -2);
+      const char* key = lua_tolstring(state, -1, &key_len);
+      message_begin_fragment(&message);
+      message_append(&message, key, key_len);
+      message_append(&message, "=", 1);
+
+      if (lua_type(state, -2) == LUA_TTABLE) {
+        if (!json_encode(state, -2, &message)) {
+          message_clean(&message);
+          return 0;
+        }
+      } else {
+        // Scalars are typed like the variables of a flattened table
+        parse_value(state, -2, parse_untyped_key_type(key, key_len),
+                    &message                                      );
+      }
+      message_end_fragment(&message);
+      lua_pop(state, 2);
+    }
   } else if (lua_gettop(state) > 1) {
-    // Parse potential ENV variables onto stack:
-    parse_kv_table(state, NULL, stack);
+    // Parse potential ENV variables onto the message:
+    lua_settop(state, 2);
+    parse_kv_table(state, &message, false);
   }
 
-  // No errors, lets parse the trigger state:
-  stack_push(stack, event);
-  stack_push(stack, TRIGGER);
-  sketchybar_call_log_and_cleanup(stack);
+  sketchybar_call_log_and_cleanup(&message);
 
   return 0;
 }
 
+int encode_json(lua_State* state) {
+  static struct message buffer;
+
+  if (lua_gettop(state) < 1) {
+    char error[] = "[Lua] Error: expecting a value as the argument for "
+                   "'json_encode'";
+    printf("%s\n", error);
+    return 0;
+  }
+
+  message_reset(&buffer);
+  if (!json_encode(state, 1, &buffer)) return 0;
+  lua_pushlstring(state, buffer.buffer, buffer.length);
+  return 1;
+}
+
 
 int set_bar_name(lua_State* state) {
   if (lua_gettop(state) < 1
@@ -708,6 +1414,51 @@ int set_bar_name(lua_State* state) {
   const char* name = lua_tostring(state, 1);
   g_port = 0;
   snprintf(g_bs_lookup, 256, "git.felix.%s", name);
+  // The remembered state belongs to the previous instance
+  shadow_invalidate_all(&g_shadow);
+  query_cache_invalidate_all(&g_query_cache);
+  return 0;
+}
+
+int set_diff_mode(lua_State* state) {
+  if (lua_gettop(state) != 1
+      || !lua_isboolean(state, 1)) {
+    char error[] = "[Lua] Error: expecting a boolean as the only argument "
+                   "for 'set_diff_mode'";
+    printf("%s\n", error);
+    return 0;
+  }
+
+  g_shadow.enabled = lua_toboolean(state, 1);
+  shadow_invalidate_all(&g_shadow);
+  return 0;
+}
+
+int set_strict_mode(lua_State* state) {
+  if (lua_gettop(state) != 1
+      || !lua_isboolean(state, 1)) {
+    char error[] = "[Lua] Error: expecting a boolean as the only argument "
+                   "for 'set_strict_mode'";
+    printf("%s\n", error);
+    return 0;
+  }
+
+  g_parse_strict = lua_toboolean(state, 1);
+  return 0;
+}
+
+int set_query_cache(lua_State* state) {
+  if (lua_gettop(state) != 1
+      || lua_type(state, 1) != LUA_TNUMBER
+      || lua_tonumber(state, 1) < 0.       ) {
+    char error[] = "[Lua] Error: expecting a non-negative number of seconds "
+                   "as the only argument for 'set_query_cache'";
+    printf("%s\n", error);
+    return 0;
+  }
+
+  g_query_cache.ttl = lua_tonumber(state, 1);
+  query_cache_invalidate_all(&g_query_cache);
   return 0;
 }
 
@@ -833,10 +1584,16 @@ static const struct luaL_Reg functions[] = {
     { "animate", animate },
     { "subscribe", subscribe },
     { "query", query },
+    { "query_many", query_many },
     { "event_loop", event_loop },
     { "hotload", hotload },
     { "set_bar_name", set_bar_name },
+    { "set_diff_mode", set_diff_mode },
+    { "set_strict_mode", set_strict_mode },
+    { "set_query_cache", set_query_cache },
+    { "prepare", prepare },
     { "trigger", trigger },
+    { "json_encode", encode_json },
     { "push", push},
     { "exec", exec },
     { "delay", delay },
@@ -848,6 +1605,8 @@ static const struct luaL_Reg functions[] = {
 int luaopen_sketchybar(lua_State* L) {
   g_state = L;
   memset(&g_callbacks, 0, sizeof(g_callbacks));
+  for (uint32_t i = 0; i < sizeof(g_builtin_events) / sizeof(char*); i++)
+    callback_names_add(&g_events, g_builtin_events[i]);
   snprintf(g_bootstrap_name, sizeof(g_bootstrap_name), MACH_HELPER_FMT,
                                                        (int)(intptr_t)L);
 
@@ -856,6 +1615,18 @@ int luaopen_sketchybar(lua_State* L) {
 
   mach_server_register(&g_mach_server, g_bootstrap_name);
 
+  luaL_newmetatable(L, TEMPLATE_METATABLE);
+  lua_newtable(L);
+  lua_pushcfunction(L, template_set);
+  lua_setfield(L, -2, "set");
+  lua_setfield(L, -2, "__index");
+  lua_pushcfunction(L, template_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_pop(L, 1);
+
+  json_lazy_register(L);
+  env_table_register(L);
+
   lua_getglobal(L, "os");
   lua_pushcfunction(L, os_execute_sig);
   lua_setfield(L, -2, "execute");
@@ -0,0 +1,75 @@
+#include "test.h"
+#include "coalesce.h"
+
+// Runs the transaction given as space separated tokens through the coalescer
+// and returns the tokens sent to sketchybar, space separated
+static const char* coalesce_tokens(const char* tokens) {
+  static char result[1024];
+  static struct coalescer coalescer;
+  struct message transaction, out;
+  message_init(&transaction);
+  message_init(&out);
+
+  char buffer[1024];
+  snprintf(buffer, sizeof(buffer), "%s", tokens);
+  for (char* token = strtok(buffer, " "); token; token = strtok(NULL, " "))
+    message_push(&transaction, token);
+
+  struct message* sent = coalesce(&coalescer, &transaction, &out)
+                         ? &out
+                         : &transaction;
+
+  uint32_t length = 0;
+  for (uint32_t i = 0; i < sent->num_fragments; i++) {
+    length += snprintf(result + length, sizeof(result) - length, "%s%s",
+                       i ? " " : "",
+                       message_fragment(sent, i)                       );
+  }
+  result[length] = '\0';
+
+  message_clean(&transaction);
+  message_clean(&out);
+  return result;
+}
+
+int main(void) {
+  // Adjacent commands of an item are merged, later values replace earlier ones
+  TEST_EXPECT_STRING(coalesce_tokens("--set a icon=1 label=x --set a icon=2"),
+                     "--set a label=x icon=2");
+  TEST_EXPECT_STRING(coalesce_tokens("--add item a left "
+                                     "--set a icon=1 "
+                                     "--set a label=x "
+                                     "--set b icon=2 "
+                                     "--set b icon=3"),
+                     "--add item a left --set a icon=1 label=x --set b icon=3");
+
+  // Relative values are never dropped
+  TEST_EXPECT_STRING(coalesce_tokens("--set a drawing=toggle "
+                                     "--set a drawing=toggle"),
+                     "--set a drawing=toggle drawing=toggle");
+  TEST_EXPECT_STRING(coalesce_tokens("--set a drawing=on "
+                                     "--set a drawing=toggle"),
+                     "--set a drawing=on drawing=toggle");
+  TEST_EXPECT_STRING(coalesce_tokens("--set a drawing=toggle label=x "
+                                     "--set a drawing=off"),
+                     "--set a label=x drawing=off");
+
+  // Commands of an item separated by another command are not reordered
+  TEST_EXPECT_STRING(coalesce_tokens("--set a icon=1 --set b icon=2 "
+                                     "--set a icon=3"),
+                     "--set a icon=1 --set b icon=2 --set a icon=3");
+  TEST_EXPECT_STRING(coalesce_tokens("--set a drawing=toggle "
+                                     "--set b drawing=on "
+                                     "--set a drawing=toggle"),
+                     "--set a drawing=toggle --set b drawing=on "
+                     "--set a drawing=toggle");
+  TEST_EXPECT_STRING(coalesce_tokens("--set a icon=1 --animate linear 10 "
+                                     "--set a icon=2"),
+                     "--set a icon=1 --animate linear 10 --set a icon=2");
+
+  // Regex targets may address any item and are never merged
+  TEST_EXPECT_STRING(coalesce_tokens("--set /a.*/ icon=1 --set /a.*/ icon=2"),
+                     "--set /a.*/ icon=1 --set /a.*/ icon=2");
+
+  return test_result("coalesce");
+}
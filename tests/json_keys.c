@@ -0,0 +1,52 @@
+#include "test.h"
+#include "json.h"
+#include <lualib.h>
+
+// Decodes the document and returns the value of the chunk run on it as `doc`
+static const char* keys_eval(lua_State* state, const char* json, const char* chunk) {
+  static char result[1024];
+  if (!json_to_lua_table(state, json)) return "invalid";
+  json_arena_reset();
+  lua_setglobal(state, "doc");
+
+  if (luaL_loadstring(state, chunk) || lua_pcall(state, 0, 1, 0)) {
+    snprintf(result, sizeof(result), "error: %s", lua_tostring(state, -1));
+  } else {
+    snprintf(result, sizeof(result), "%s", luaL_tolstring(state, -1, NULL));
+    lua_pop(state, 1);
+  }
+  lua_pop(state, 1);
+  return result;
+}
+
+static lua_State* keys_new_state(void) {
+  lua_State* state = luaL_newstate();
+  luaL_openlibs(state);
+  return state;
+}
+
+int main(void) {
+  static const char json[] = "{\"name\": \"a\", \"geometry\": {\"width\": 10}}";
+  static const char chunk[] = "return doc.name .. doc.geometry.width";
+
+  // The cached keys of one state are never handed to another one
+  lua_State* first = keys_new_state();
+  lua_State* second = keys_new_state();
+  TEST_EXPECT_STRING(keys_eval(first, json, chunk), "a10");
+  TEST_EXPECT_STRING(keys_eval(second, json, chunk), "a10");
+  TEST_EXPECT_STRING(keys_eval(first, json, chunk), "a10");
+  lua_close(first);
+
+  lua_State* third = keys_new_state();
+  TEST_EXPECT_STRING(keys_eval(third, json, chunk), "a10");
+  TEST_EXPECT_STRING(keys_eval(second, json, chunk), "a10");
+  lua_close(second);
+  lua_close(third);
+
+  // Decoding leaves nothing but the decoded table on the stack
+  lua_State* state = keys_new_state();
+  TEST_EXPECT(json_to_lua_table(state, json) && lua_gettop(state) == 1);
+  TEST_EXPECT(!json_to_lua_table(state, "{\"name\": ") && lua_gettop(state) == 1);
+  lua_close(state);
+  return test_result("json_keys");
+}
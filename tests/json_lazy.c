@@ -0,0 +1,86 @@
+#include "test.h"
+#include "json.h"
+#include <lualib.h>
+#include <stdlib.h>
+
+// Evaluates the chunk with the lazy proxy of the document as `doc` and
+// returns its result converted to a string
+static const char* lazy_eval(lua_State* state, const char* json, const char* chunk) {
+  static char result[1024];
+  // The proxy takes ownership of the document
+  char* copy = malloc(strlen(json) + 1);
+  memcpy(copy, json, strlen(json) + 1);
+  if (!json_lazy_push(state, copy)) return "invalid";
+  lua_setglobal(state, "doc");
+
+  if (luaL_loadstring(state, chunk) || lua_pcall(state, 0, 1, 0)) {
+    snprintf(result, sizeof(result), "error: %s", lua_tostring(state, -1));
+  } else {
+    snprintf(result, sizeof(result), "%s", luaL_tolstring(state, -1, NULL));
+    lua_pop(state, 1);
+  }
+  lua_pop(state, 1);
+  return result;
+}
+
+// Lists the key value pairs of the document in iteration order
+static const char g_pairs[] = "local out = {}"
+                              "for k, v in pairs(doc) do"
+                              "  out[#out + 1] = k .. '=' .. tostring(v)"
+                              "end "
+                              "return table.concat(out, ' ')";
+
+int main(void) {
+  lua_State* state = luaL_newstate();
+  luaL_openlibs(state);
+  json_lazy_register(state);
+
+  TEST_EXPECT_STRING(lazy_eval(state, "{\"a\": 1, \"b\": \"x\"}",
+                               "return doc.a .. doc.b .. tostring(doc.c)"),
+                     "1xnil");
+  TEST_EXPECT_STRING(lazy_eval(state, "{\"a\\u0062\": 1}", "return doc.ab"),
+                     "1");
+  TEST_EXPECT_STRING(lazy_eval(state, "[10, [20], 30]",
+                               "return doc[1] + doc[2][1] + doc[3]"),
+                     "60");
+
+  // Duplicate keys resolve to the last entry, like in a decoded table
+  TEST_EXPECT_STRING(lazy_eval(state, "{\"a\": 1, \"b\": 2, \"a\": 3}",
+                               "return doc.a"),
+                     "3");
+  TEST_EXPECT_STRING(lazy_eval(state, "{\"a\": 1, \"b\": 2, \"a\": 3}",
+                               g_pairs),
+                     "b=2 a=3");
+  TEST_EXPECT_STRING(lazy_eval(state, "{\"a\": 1, \"a\": null}",
+                               "return tostring(doc.a)"),
+                     "nil");
+  TEST_EXPECT_STRING(lazy_eval(state, "{\"a\": 1, \"a\": null}", g_pairs),
+                     "");
+  TEST_EXPECT_STRING(lazy_eval(state, "{\"a\": 1, \"b\": 2, \"a\": 3}",
+                               "local b = doc.b "
+                               "return b .. ' ' .. doc.a"),
+                     "2 3");
+
+  // Nested proxies are decoded once and served from the cache after
+  TEST_EXPECT_STRING(lazy_eval(state, "{\"a\": {\"b\": [1]}}",
+                               "return rawequal(doc.a, doc.a)"
+                               "   and rawequal(doc.a.b, doc.a.b)"),
+                     "true");
+
+  // Objects larger than the initial index are found by their key
+  char json[8192];
+  uint32_t length = snprintf(json, sizeof(json), "{");
+  for (uint32_t i = 0; i < 500; i++) {
+    length += snprintf(json + length, sizeof(json) - length, "%s\"key%u\": %u",
+                       i ? ", " : "", i, i);
+  }
+  snprintf(json + length, sizeof(json) - length, "}");
+  TEST_EXPECT_STRING(lazy_eval(state, json,
+                               "local sum = 0 "
+                               "for i = 0, 499 do sum = sum + doc['key' .. i] end "
+                               "return sum .. tostring(doc.key500)"),
+                     "124750nil");
+
+  lua_close(state);
+  return test_result("json_lazy");
+}
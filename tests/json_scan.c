@@ -0,0 +1,74 @@
+#include "test.h"
+#include "json_scan.h"
+#include <stdlib.h>
+
+// Compares the (SIMD) scanners of the decoder with their scalar versions on
+// random inputs, at every alignment and with every tail length up to a few
+// blocks. The bytes are drawn mostly from the ones the scanners look for
+// and from their neighbours, including bytes above 127.
+
+#define SCAN_ALIGNMENTS 16
+#define SCAN_MAX_LENGTH 80
+#define SCAN_ROUNDS 200
+
+static const unsigned char g_scan_bytes[] = { ' ', '\t', '\n', '\r', 0, 1, 31,
+                                              32, 33, '"', '\\', '!', '#',
+                                              '[', ']', 'a', 127, 128, 160,
+                                              0xdc, 0xe2, 0xff              };
+
+static void scan_fill(char* buffer, uint32_t length, uint32_t density) {
+  for (uint32_t i = 0; i < length; i++) {
+    // Long runs of whitespace or plain text, with the occasional other byte
+    if ((uint32_t)rand() % 100 < density)
+      buffer[i] = g_scan_bytes[rand() % sizeof(g_scan_bytes)];
+    else
+      buffer[i] = rand() % 2 ? ' ' : 'x';
+  }
+}
+
+int main(void) {
+  srand(19);
+  char buffer[SCAN_ALIGNMENTS + SCAN_MAX_LENGTH + 1];
+  uint32_t mismatches = 0;
+
+  for (uint32_t round = 0; round < SCAN_ROUNDS; round++) {
+    for (uint32_t alignment = 0; alignment < SCAN_ALIGNMENTS; alignment++) {
+      for (uint32_t length = 0; length <= SCAN_MAX_LENGTH; length++) {
+        char* begin = buffer + alignment;
+        char* end = begin + length;
+        scan_fill(buffer, sizeof(buffer), round % 4 ? 2 + round % 20 : 0);
+
+        if (json_whitespace_end(begin, end)
+            != json_scalar_whitespace_end(begin, end)) {
+          mismatches++;
+        }
+        if (json_find_special(begin, end)
+            != json_scalar_find_special(begin, end)) {
+          mismatches++;
+        }
+      }
+    }
+  }
+  TEST_EXPECT(mismatches == 0);
+
+  // Every position of a single match within and after the first blocks
+  for (uint32_t alignment = 0; alignment < SCAN_ALIGNMENTS; alignment++) {
+    char* begin = buffer + alignment;
+    for (uint32_t length = 1; length <= SCAN_MAX_LENGTH; length++) {
+      for (uint32_t match = 0; match < length; match++) {
+        memset(buffer, ' ', sizeof(buffer));
+        begin[match] = '\\';
+        TEST_EXPECT(json_whitespace_end(begin, begin + length)
+                    == begin + match                          );
+        TEST_EXPECT(json_find_special(begin, begin + length)
+                    == begin + match                        );
+        memset(buffer, 'x', sizeof(buffer));
+        begin[match] = '"';
+        TEST_EXPECT(json_find_special(begin, begin + length)
+                    == begin + match                        );
+      }
+    }
+  }
+
+  return test_result("json_scan");
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// The tests are standalone programs built and run by `make test`, every
+// failed expectation is printed and fails the test program
+
+static uint32_t g_test_failures = 0;
+
+#define TEST_EXPECT(condition) do { \
+  if (!(condition)) { \
+    printf("%s:%d: expected %s\n", __FILE__, __LINE__, #condition); \
+    g_test_failures++; \
+  } \
+} while (0)
+
+#define TEST_EXPECT_STRING(actual, expected) do { \
+  if (strcmp(actual, expected) != 0) { \
+    printf("%s:%d: expected '%s', got '%s'\n", __FILE__, __LINE__, \
+                                               expected, actual  ); \
+    g_test_failures++; \
+  } \
+} while (0)
+
+static inline int test_result(const char* name) {
+  if (g_test_failures) printf("%s: %u failures\n", name, g_test_failures);
+  else printf("%s: ok\n", name);
+  return g_test_failures ? 1 : 0;
+}
@@ -0,0 +1,258 @@
+#!/usr/bin/env python3
+# Generates src/schema.h, a perfect hash table classifying the dot separated
+# key paths of sketchybar properties (e.g. `background.border_color` or
+# `icon.font.size`) by the type of value they take.
+#
+# Usage: python3 tools/schema.py > src/schema.h
+
+COLOR = "PROPERTY_COLOR"
+BOOLEAN = "PROPERTY_BOOLEAN"
+INTEGER = "PROPERTY_INTEGER"
+FLOAT = "PROPERTY_FLOAT"
+STRING = "PROPERTY_STRING"
+
+TYPES = [COLOR, BOOLEAN, INTEGER, FLOAT, STRING]
+
+# A property group maps the names of its properties either to their type, to
+# a nested group, or to a tuple of both for properties that take a value
+# themselves and also have nested properties (e.g. `font` and `font.size`).
+
+SHADOW = {
+    "drawing": BOOLEAN,
+    "color": COLOR,
+    "angle": INTEGER,
+    "distance": INTEGER,
+}
+
+IMAGE = {
+    "drawing": BOOLEAN,
+    "string": STRING,
+    "scale": FLOAT,
+    "border_color": COLOR,
+    "border_width": INTEGER,
+    "corner_radius": INTEGER,
+    "padding_left": INTEGER,
+    "padding_right": INTEGER,
+    "y_offset": INTEGER,
+}
+
+BACKGROUND = {
+    "drawing": BOOLEAN,
+    "color": COLOR,
+    "border_color": COLOR,
+    "border_width": INTEGER,
+    "height": INTEGER,
+    "corner_radius": INTEGER,
+    "padding_left": INTEGER,
+    "padding_right": INTEGER,
+    "x_offset": INTEGER,
+    "y_offset": INTEGER,
+    "clip": FLOAT,
+    "image": (STRING, IMAGE),
+    "shadow": SHADOW,
+}
+
+FONT = {
+    "family": STRING,
+    "style": STRING,
+    "size": FLOAT,
+}
+
+TEXT = {
+    "drawing": BOOLEAN,
+    "highlight": BOOLEAN,
+    "string": STRING,
+    "color": COLOR,
+    "highlight_color": COLOR,
+    "padding_left": INTEGER,
+    "padding_right": INTEGER,
+    "y_offset": INTEGER,
+    "width": INTEGER,
+    "align": STRING,
+    "max_chars": INTEGER,
+    "scroll_duration": INTEGER,
+    "font": (STRING, FONT),
+    "background": BACKGROUND,
+    "shadow": SHADOW,
+}
+
+POPUP = {
+    "drawing": BOOLEAN,
+    "horizontal": BOOLEAN,
+    "topmost": BOOLEAN,
+    "align": STRING,
+    "height": INTEGER,
+    "y_offset": INTEGER,
+    "blur_radius": INTEGER,
+    "background": BACKGROUND,
+}
+
+GRAPH = {
+    "color": COLOR,
+    "fill_color": COLOR,
+    "line_width": FLOAT,
+}
+
+SLIDER = {
+    "highlight_color": COLOR,
+    "percentage": INTEGER,
+    "width": INTEGER,
+    "knob": (STRING, TEXT),
+    "background": BACKGROUND,
+}
+
+ALIAS = {
+    "color": COLOR,
+    "scale": FLOAT,
+    "update_freq": INTEGER,
+}
+
+# The properties of items (`--set` and `--default`) and of the bar (`--bar`)
+PROPERTIES = {
+    # Items
+    "drawing": BOOLEAN,
+    "position": STRING,
+    "space": INTEGER,
+    "display": INTEGER,
+    "associated_space": INTEGER,
+    "associated_display": INTEGER,
+    "ignore_association": BOOLEAN,
+    "y_offset": INTEGER,
+    "padding_left": INTEGER,
+    "padding_right": INTEGER,
+    "width": INTEGER,
+    "scroll_texts": BOOLEAN,
+    "blur_radius": INTEGER,
+    "script": STRING,
+    "click_script": STRING,
+    "update_freq": INTEGER,
+    "updates": BOOLEAN,
+    "mach_helper": STRING,
+    "icon": (STRING, TEXT),
+    "label": (STRING, TEXT),
+    "background": BACKGROUND,
+    "popup": POPUP,
+    "graph": GRAPH,
+    "slider": SLIDER,
+    "alias": ALIAS,
+    # The bar
+    "color": COLOR,
+    "border_color": COLOR,
+    "border_width": INTEGER,
+    "height": INTEGER,
+    "margin": INTEGER,
+    "corner_radius": INTEGER,
+    "notch_width": INTEGER,
+    "notch_offset": INTEGER,
+    "notch_display_height": INTEGER,
+    "hidden": BOOLEAN,
+    "topmost": BOOLEAN,
+    "sticky": BOOLEAN,
+    "font_smoothing": BOOLEAN,
+    "shadow": BOOLEAN,
+    "image": (STRING, IMAGE),
+}
+
+
+def key_paths(group, prefix=""):
+    for name, value in group.items():
+        path = prefix + name
+        if isinstance(value, tuple):
+            yield path, value[0]
+            value = value[1]
+        if isinstance(value, dict):
+            yield from key_paths(value, path + ".")
+        elif isinstance(value, str):
+            yield path, value
+
+
+# hash_fnv of src/hash.h
+HASH_SEED = 2166136261
+
+
+def fnv(seed, key):
+    h = seed
+    for c in key.encode():
+        h = ((h ^ c) * 16777619) & 0xffffffff
+    return h
+
+
+def perfect_hash(keys):
+    # Hash and displace: every key is first hashed into a bucket, each bucket
+    # then gets a seed such that the second hash maps all of its keys into
+    # free slots.
+    size = len(keys)
+    buckets = [[] for _ in range(size)]
+    for key in keys:
+        buckets[fnv(HASH_SEED, key) % size].append(key)
+
+    seeds = [0] * size
+    slots = [None] * size
+    for bucket in sorted(range(size), key=lambda b: -len(buckets[b])):
+        if not buckets[bucket]:
+            continue
+        seed = 1
+        while True:
+            taken = [fnv(seed, key) % size for key in buckets[bucket]]
+            if (len(set(taken)) == len(taken)
+                    and all(slots[slot] is None for slot in taken)):
+                break
+            seed += 1
+        seeds[bucket] = seed
+        for key, slot in zip(buckets[bucket], taken):
+            slots[slot] = key
+    return seeds, slots
+
+
+def main():
+    types = dict(key_paths(PROPERTIES))
+    seeds, slots = perfect_hash(sorted(types))
+
+    out = []
+    out.append("#pragma once")
+    out.append("// Generated by tools/schema.py, do not edit.")
+    out.append("#include \"hash.h\"")
+    out.append("#include <stdint.h>")
+    out.append("#include <string.h>")
+    out.append("")
+    out.append("enum property_type {")
+    out.append("  PROPERTY_UNKNOWN,")
+    for name in TYPES:
+        out.append("  %s," % name)
+    out.append("};")
+    out.append("")
+    out.append("struct property {")
+    out.append("  const char* name;")
+    out.append("  uint32_t length;")
+    out.append("  enum property_type type;")
+    out.append("};")
+    out.append("")
+    out.append("#define SCHEMA_SIZE %d" % len(slots))
+    out.append("")
+    out.append("static const uint32_t g_schema_seeds[SCHEMA_SIZE] = {")
+    for i in range(0, len(seeds), 8):
+        out.append("  " + ", ".join("%d" % s for s in seeds[i:i + 8]) + ",")
+    out.append("};")
+    out.append("")
+    out.append("static const struct property g_schema[SCHEMA_SIZE] = {")
+    for key in slots:
+        out.append("  { \"%s\", %d, %s }," % (key, len(key), types[key]))
+    out.append("};")
+    out.append("")
+    out.append("// Classifies a dot separated property key path")
+    out.append("static inline enum property_type schema_classify(const char* key, uint32_t length) {")
+    out.append("  uint32_t seed = g_schema_seeds[hash_fnv(HASH_SEED, key, length) % SCHEMA_SIZE];")
+    out.append("  const struct property* property")
+    out.append("                  = &g_schema[hash_fnv(seed, key, length) % SCHEMA_SIZE];")
+    out.append("")
+    out.append("  if (property->length != length")
+    out.append("      || memcmp(property->name, key, length) != 0) {")
+    out.append("    return PROPERTY_UNKNOWN;")
+    out.append("  }")
+    out.append("  return property->type;")
+    out.append("}")
+    print("\n".join(out))
+
+
+if __name__ == "__main__":
+    main()